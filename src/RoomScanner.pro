@@ -11,6 +11,9 @@ greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 TARGET = RoomScanner
 TEMPLATE = app
 
+QMAKE_CXXFLAGS += -fopenmp
+LIBS += -fopenmp
+
 
 SOURCES += main.cpp\
         application.cpp \
@@ -18,7 +21,20 @@ SOURCES += main.cpp\
     registration.cpp \
     texturing.cpp \
     filters.cpp \
-    clicklabel.cpp
+    clicklabel.cpp \
+    tsdf.cpp \
+    marchingcubes.cpp \
+    keypoints.cpp \
+    cache.cpp \
+    chunkstore.cpp \
+    compact.cpp \
+    pool.cpp \
+    memo.cpp \
+    sweep.cpp \
+    progress.cpp \
+    lod.cpp \
+    trimesh.cpp \
+    parameters.cpp
 
 HEADERS  += application.h \
     parameters.h \
@@ -28,7 +44,19 @@ HEADERS  += application.h \
     mesh.h \
     registration.h \
     texturing.h \
-    clicklabel.h
+    clicklabel.h \
+    tsdf.h \
+    marchingcubes.h \
+    keypoints.h \
+    cache.h \
+    chunkstore.h \
+    compact.h \
+    pool.h \
+    memo.h \
+    sweep.h \
+    progress.h \
+    lod.h \
+    trimesh.h
 
 FORMS    += application.ui
 
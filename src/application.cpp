@@ -19,7 +19,6 @@
 #include "../build/ui_application.h"
 
 
-parameters* parameters::instance = 0;
 
 /** \brief Constructor and initializing gui
   * \param parent
@@ -69,6 +68,21 @@ RoomScanner::RoomScanner (QWidget *parent) :
     viewer->setupInteractor (ui->qvtkWidget->GetInteractor (), ui->qvtkWidget->GetRenderWindow ());
     viewer->registerKeyboardCallback (&RoomScanner::keyboardEventOccurred, *this);
 
+    // big clouds are streamed to viewer by level of detail
+    lodView.reset (new lod (viewer));
+    lodTimer = new QTimer(this);
+    connect(lodTimer, SIGNAL(timeout()), this, SLOT(lodRefresh()));
+    lodTimer->start(100); // msec
+
+    // keypoints are drawn big and green by render properties, points keep their data
+    lod::style keypointStyle;
+    keypointStyle.colored = true;
+    keypointStyle.r = 0.0;
+    keypointStyle.g = 1.0;
+    keypointStyle.b = 0.0;
+    keypointStyle.pointSize = 10;
+    lodView->setStyle("keypoints", keypointStyle);
+
     ui->qvtkWidget->update ();
 
     meshViewer.reset (new pcl::visualization::PCLVisualizer ("meshViewer", false));
@@ -138,6 +152,9 @@ RoomScanner::RoomScanner (QWidget *parent) :
     //Connect reseting camera
     connect(this, SIGNAL(resetCameraSignal()), this, SLOT(resetCameraSlot()));
 
+    //Connect showing of saved frame, queued to gui thread from saving job
+    connect(this, SIGNAL(frameSavedSignal()), this, SLOT(lastFrameToggled()));
+
     //Connect keypoint action
     connect(ui->actionSave_registered_cloud, SIGNAL(triggered()), this, SLOT(saveRegFrame()));
 
@@ -187,23 +204,13 @@ void RoomScanner::drawFrame() {
             filters::downsample(kinectCloud, *tmp, 0.05);
 
             // estimate the sift interest points
-            pcl::SIFTKeypoint<PointT, pcl::PointWithScale> sift;
             pcl::PointCloud<pcl::PointWithScale> result;
-            pcl::search::KdTree<PointT>::Ptr tree(new pcl::search::KdTree<PointT> ());
-            sift.setSearchMethod(tree);
-            sift.setScales(params->SIFTmin_scale, params->SIFTn_octaves, params->SIFTn_scales_per_octave);
-            sift.setMinimumContrast(params->SIFTmin_contrast);
-            sift.setInputCloud(tmp);
-            sift.compute(result);
+            keypoints::sift(tmp, result, params->SIFTmin_scale, params->SIFTn_octaves, params->SIFTn_scales_per_octave, params->SIFTmin_contrast);
 
             copyPointCloud(result, *key_cloud); // from PointWithScale to PointCloudAT
 
-            for (int var = 0; var < key_cloud->size(); ++var) {
-                key_cloud->points[var].r = 0;
-                key_cloud->points[var].g = 255;
-                key_cloud->points[var].b = 0;
-            }
             viewer->updatePointCloud(key_cloud,"keypoints");
+            lodView->applyStyle("keypoints");
         }
         viewer->updatePointCloud(kinectCloud,"kinectCloud");
         emit(resetCameraSignal());
@@ -278,6 +285,14 @@ void RoomScanner::resetButtonPressed() {
     ui->qvtkWidget->update();
 }
 
+/** \brief streams level of detail of displayed clouds for current camera
+  */
+void RoomScanner::lodRefresh() {
+    if (lodView->refresh()) {
+        ui->qvtkWidget->update();
+    }
+}
+
 /** \brief run loading screen and runs second thread
   */
 void RoomScanner::saveButtonPressed() {
@@ -285,9 +300,7 @@ void RoomScanner::saveButtonPressed() {
         PCL_INFO("Nothing to save.\n");
         return;
     }
-    boost::thread* thr2 = new boost::thread(boost::bind(&RoomScanner::saveButtonPressedFun, this));
-    labelSave = new clickLabel(thr2);
-    loading(labelSave);
+    startJob("Saving", &RoomScanner::saveButtonPressedFun, labelSave, LSAV);
 }
 
 /** \brief save current frame from sensor
@@ -330,12 +343,11 @@ void RoomScanner::saveButtonPressedFun() {
     images.push_back(s);
 
     // perform filtering
-    filters::cloudSmoothFBF(tmp, output);
-    std::vector<int> indices;
-    removeNaNFromPointCloud(*output,*output, indices);
-    filters::oultlierRemoval(output, output, 0.8f);
-    clouds.push_back(output);
-    lastFrameToggled();
+    parameters* params = parameters::GetInstance();
+    filters::preprocessFrame(tmp, output, params->PREcapture);
+    clouds.push_back(compactCloud::Ptr (new compactCloud (*output, params->COMPACTresolution)));
+    // viewer is touched only from gui thread
+    emit(frameSavedSignal());
     stream = true;
     //labelSave->close();
     emit(closeLabelSignal(LSAV));
@@ -356,6 +368,7 @@ void RoomScanner::saveButtonPressedFun() {
   */
 void RoomScanner::loadActionPressed() {
     parameters* params = parameters::GetInstance();
+    lodView->clear();
     viewer->removeAllPointClouds();
     ui->tabWidget->setCurrentIndex(0);
     QStringList fileNames = QFileDialog::getOpenFileNames(this, tr("Choose Point Cloud Files"),QDir::currentPath(), tr("Point Cloud Files (*.pcd)") );
@@ -384,23 +397,14 @@ void RoomScanner::loadActionPressed() {
                 pcl::io::savePNGFile(s, *image);
                 images.push_back(s);
             }
-            for (size_t i = 0; i < cloudFromFile->size(); i++)
-            {
-                cloudFromFile->points[i].a = 255;
-                if (cloudFromFile->points[i].r == 0 && cloudFromFile->points[i].g == 0 && cloudFromFile->points[i].b == 0 ) {
-                    cloudFromFile->points[i].r = 127;
-                    cloudFromFile->points[i].g = 127;
-                    cloudFromFile->points[i].b = 127;
-                }
-
-            }
             PCL_INFO("PC Loaded from file %s. Points %d\n", utf8_fileName.c_str(), cloudFromFile->points.size());
 
             cloudFromFile->sensor_orientation_ = params->m;
-            filters::cloudSmoothFBF(cloudFromFile, cloudFromFile);
+            filters::preprocessFrame(cloudFromFile, cloudFromFile, params->PREload);
             viewer->removeAllPointClouds();
-            viewer->addPointCloud(cloudFromFile,"cloudFromFile");
-            clouds.push_back(cloudFromFile); 
+            lodView->show(cloudFromFile, "cloudFromFile");
+            // organized frame keeps pixel to point mapping for image features
+            clouds.push_back(compactCloud::Ptr (new compactCloud (*cloudFromFile, params->COMPACTresolution)));
             //this is some weird bug with multithreading and refreshing gui
             //ui->qvtkWidget->update();
             //viewer->resetCamera();
@@ -417,9 +421,7 @@ void RoomScanner::polyButtonPressed() {
     if (clouds.empty()) {
         if (sensorConnected) {
             ui->tabWidget->setCurrentIndex(1);
-            boost::thread* thr2 = new boost::thread(boost::bind(&RoomScanner::polyButtonPressedFunc, this));
-            labelPolygonate = new clickLabel(thr2);
-            loading(labelPolygonate);
+            startJob("Polygonation", &RoomScanner::polyButtonPressedFunc, labelPolygonate, LPOL);
         }
         else {
             // empty clouds & no sensor
@@ -436,14 +438,46 @@ void RoomScanner::polyButtonPressed() {
         }
         else {
             ui->tabWidget->setCurrentIndex(1);
-            boost::thread* thr2 = new boost::thread(boost::bind(&RoomScanner::polyButtonPressedFunc, this));
-            labelPolygonate = new clickLabel(thr2);
-            loading(labelPolygonate);
+            startJob("Polygonation", &RoomScanner::polyButtonPressedFunc, labelPolygonate, LPOL);
         }
     }
     ui->qvtkWidget_2->update();
 }
 
+/** \brief runs member function in second thread as cancellable job with loading screen
+  * \param name name of job shown by loading screen
+  * \param function job to run
+  * \param label resultant loading screen, set before the job starts
+  * \param index index of loading screen closed when job is cancelled
+  */
+void RoomScanner::startJob(const std::string &name, void (RoomScanner::*function)(), clickLabel* &label, int index) {
+    progress::Ptr job(new progress(name));
+    label = new clickLabel(job);
+    loading(label);
+    new boost::thread(boost::bind(&RoomScanner::runJob, this, job, function, index));
+}
+
+/** \brief body of job thread, cancelled or failed job unwinds here and closes its loading screen
+  * \param job progress and cancellation token of job
+  * \param function job to run
+  * \param index index of loading screen
+  */
+void RoomScanner::runJob(progress::Ptr job, void (RoomScanner::*function)(), int index) {
+    progress::setCurrent(job);
+    try {
+        (this->*function)();
+    }
+    catch (const progress::cancelledException &) {
+        PCL_INFO("%s cancelled\n", job->getName().c_str());
+        emit(closeLabelSignal(index));
+    }
+    catch (const std::exception &e) {
+        PCL_ERROR("%s failed: %s\n", job->getName().c_str(), e.what());
+        emit(closeLabelSignal(index));
+    }
+    progress::setCurrent(progress::Ptr());
+}
+
 /** \brief loading screen
   */
 void RoomScanner::loading(clickLabel* label) {
@@ -467,10 +501,10 @@ void RoomScanner::loading(clickLabel* label) {
 /** \brief determines what and polygonates it
   */
 void RoomScanner::polyButtonPressedFunc() {
-    PointCloudT::Ptr cloudtmp (new PointCloudT);
-    PointCloudT::Ptr output (new PointCloudT);
-    PointCloudT::Ptr holder (new PointCloudT);
-    triangles.reset(new pcl::PolygonMesh);
+    pool::job job("polygonation");
+    PointCloudT::Ptr cloudtmp = pool::cloud();
+    triangles.reset(new trimesh);
+    parameters* params = parameters::GetInstance();
 
     pcl::console::TicToc tt;
     tt.tic();
@@ -481,96 +515,135 @@ void RoomScanner::polyButtonPressedFunc() {
     //                               \--- non empty clouds --- registered cloud?
     //                                                                          \--- register & polygonate?
     //
+    // stages are memoized, only those reading changed parameters run again
+
+    // surface reconstruction of unorganized cloud selected in gui
+    std::string stage = "poisson";
+    memo::meshStage mesher = &mesh::polygonateCloudPoisson;
+    if (ui->radioButton_GT->isChecked()) {
+        stage = "greedy";
+        mesher = &mesh::polygonateCloudGreedyProj;
+    }
+    else if (ui->radioButton_GP->isChecked()){
+        stage = "grid";
+        mesher = &mesh::polygonateCloudGridProj;
+    }
+    else if (ui->radioButton_MC->isChecked()){
+        stage = "mc";
+        mesher = &mesh::polygonateCloudMC;
+    }
 
-    if (clouds.empty()) {
-        if (sensorConnected) {
-
-            cloudtmp->clear();
-            //keep point cloud organized
-            cloudtmp->width = cloudWidth;
-            cloudtmp->height = cloudHeight;
-            cloudtmp->points.resize(cloudHeight*cloudWidth);
-            cloudtmp->is_dense = false;
-            // Fill cloud
-            float *pX = &cloudX[0];
-            float *pY = &cloudY[0];
-            float *pZ = &cloudZ[0];
-            unsigned long *pRGB = &cloudRGB[0];
-
-            for(int i = 0; i < kinectCloud->points.size(); i++,pX++,pY++,pZ++,pRGB++) {
-                cloudtmp->points[i].x = (*pX);
-                cloudtmp->points[i].y = (*pY);
-                cloudtmp->points[i].z = (*pZ);
-                cloudtmp->points[i].rgba = (*pRGB);
-            }
+    memo::meshResult surface;
+    {
+        progress::section meshing(0.0, 0.8);
+        if (clouds.empty()) {
+            if (sensorConnected) {
+
+                cloudtmp->clear();
+                //keep point cloud organized
+                cloudtmp->width = cloudWidth;
+                cloudtmp->height = cloudHeight;
+                cloudtmp->points.resize(cloudHeight*cloudWidth);
+                cloudtmp->is_dense = false;
+                // Fill cloud
+                float *pX = &cloudX[0];
+                float *pY = &cloudY[0];
+                float *pZ = &cloudZ[0];
+                unsigned long *pRGB = &cloudRGB[0];
+
+                for(int i = 0; i < cloudtmp->points.size(); i++,pX++,pY++,pZ++,pRGB++) {
+                    cloudtmp->points[i].x = (*pX);
+                    cloudtmp->points[i].y = (*pY);
+                    cloudtmp->points[i].z = (*pZ);
+                    cloudtmp->points[i].rgba = (*pRGB);
+                }
 
-            PCL_INFO("Empty clouds & sensor connected\n");
+                PCL_INFO("Empty clouds & sensor connected\n");
 
-            filters::cloudSmoothFBF(cloudtmp, output);
-            //filters::bilatelarUpsampling(cloudtmp, output);
-            filters::voxelGridFilter(output, output, 0.02);
+                memo::cloudResult smoothed = memo::cloud("fbf", &filters::cloudSmoothFBF, memo::input(cloudtmp));
+                //filters::bilatelarUpsampling(cloudtmp, output);
 
-            if (ui->radioButton_GT->isChecked()) {
-                mesh::polygonateCloudGreedyProj(output, triangles);
-            }
-            else if (ui->radioButton_GP->isChecked()){
-                mesh::polygonateCloudGridProj(output, triangles);
-            }
-            else {
-                mesh::polygonateCloudPoisson(output, triangles);
-            }
+                if (ui->radioButton_MC->isChecked()) {
+                    // fuse single organized frame into volume
+                    surface = memo::mesh("tsdf", &tsdf::meshFrame, smoothed);
+                }
+                else {
+                    memo::cloudResult sparse = memo::cloud("voxel 0.02", boost::bind(&filters::voxelGridFilter, _1, _2, 0.02f), smoothed);
+                    surface = memo::mesh(stage, mesher, sparse);
+                }
 
-        }
-        else {
-            PCL_INFO("Empty clouds & sensor disconnected\n");
-            QMessageBox::warning(this, "Error", "No pointcloud to polygonate!");
-            PCL_INFO("No cloud to polygonate!\n");
-            return;
-        }
-    }
-    else {
-        if (registered) {
-            PCL_INFO("Registered clouds to polygonate\n");
-            if (ui->radioButton_GT->isChecked()) {
-                mesh::polygonateCloudGreedyProj(regResult, triangles);
-            }
-            else if (ui->radioButton_GP->isChecked()){
-                mesh::polygonateCloudGridProj(regResult, triangles);
             }
             else {
-                mesh::polygonateCloudPoisson(regResult, triangles);
+                PCL_INFO("Empty clouds & sensor disconnected\n");
+                QMessageBox::warning(this, "Error", "No pointcloud to polygonate!");
+                PCL_INFO("No cloud to polygonate!\n");
+                return;
             }
         }
         else {
-            PCL_INFO("Cloud to polygonate\n");
-            filters::cloudSmoothFBF(clouds.back(), clouds.back());
-            if (ui->radioButton_GT->isChecked()) {
-                mesh::polygonateCloudGreedyProj(clouds.back(), triangles);
-            }
-            else if (ui->radioButton_GP->isChecked()){
-                mesh::polygonateCloudGridProj(clouds.back(), triangles);
+            if (registered) {
+                PCL_INFO("Registered clouds to polygonate\n");
+                // local meshers can run on chunks with overlap, poisson needs whole cloud
+                float halo = 0.0f;
+                if (ui->radioButton_GT->isChecked()) {
+                    halo = 2 * params->GPsearchRadius;
+                }
+                else if (ui->radioButton_GP->isChecked()){
+                    halo = 8 * params->GRres;
+                }
+                else if (ui->radioButton_MC->isChecked()){
+                    halo = 2 * (params->MCdistIgnore + params->MCresolution);
+                }
+
+                if (ui->radioButton_MC->isChecked() && volume) {
+                    trimesh::Ptr extracted(new trimesh);
+                    volume->extractMesh(*extracted);
+                    surface = memo::input(extracted);
+                }
+                else if (halo > 0.0f && regResult->size() * sizeof(PointT) > params->CHUNKbudget * 1024 * 1024) {
+                    PCL_INFO("Cloud exceeds memory budget, meshing by chunks\n");
+                    // store is keyed by its content, mesher and chunk size make the stage
+                    memo::cloudResult stored;
+                    stored.key = regResult->key();
+                    std::stringstream chunked;
+                    chunked << stage << " chunks " << params->CHUNKsize;
+                    surface = memo::mesh(chunked.str(), boost::bind(&chunkstore::mesh, regResult, mesher, halo, _2), stored);
+                }
+                else {
+                    PointCloudT::Ptr registeredCloud (new PointCloudT);
+                    regResult->extract(*registeredCloud);
+                    surface = memo::mesh(stage, mesher, memo::input(registeredCloud));
+                }
             }
             else {
-                mesh::polygonateCloudPoisson(clouds.back(), triangles);
+                PCL_INFO("Cloud to polygonate\n");
+                // captured frame stays untouched, smoothed copy is memoized
+                PointCloudT::Ptr lastFrame (new PointCloudT);
+                clouds.back()->toCloud(*lastFrame);
+                memo::cloudResult smoothed = memo::cloud("fbf", &filters::cloudSmoothFBF, memo::input(lastFrame));
+                if (ui->radioButton_MC->isChecked() && smoothed.cloud->isOrganized()) {
+                    surface = memo::mesh("tsdf", &tsdf::meshFrame, smoothed);
+                }
+                else {
+                    surface = memo::mesh(stage, mesher, smoothed);
+                }
             }
         }
     }
 
-    meshViewer->removePolygonMesh("mesh");
-
-    if (ui->groupBox_6->isChecked()) {
-        // Hole Filling
-        pcl::PolygonMesh::Ptr trianglesFilled(new pcl::PolygonMesh);
-        mesh::fillHoles(triangles, trianglesFilled);
-        PCL_INFO("After holefilling: %d\n", trianglesFilled->polygons.size());
-        triangles = trianglesFilled;
-    }
-
-    if (ui->groupBox_7->isChecked()) {
-        pcl::PolygonMesh::Ptr trianglesDecimated(new pcl::PolygonMesh);
-        mesh::meshDecimation(triangles, trianglesDecimated);
-        triangles = trianglesDecimated;
+    meshViewer->removeShape("mesh");
+
+    // hole filling and decimation run as one pipeline, its output is shown as is
+    const bool holes = ui->groupBox_6->isChecked();
+    const bool decimation = ui->groupBox_7->isChecked();
+    vtkSmartPointer<vtkPolyData> shown;
+    if (holes || decimation) {
+        progress::section post(0.8, 1.0);
+        const std::string stage = holes ? (decimation ? "holes+decimation" : "holes") : "decimation";
+        surface = memo::post(stage, boost::bind(&mesh::postProcess, _1, _2, holes, decimation, &shown), surface);
+        PCL_INFO("After post-processing: %d\n", surface.mesh->triangleCount());
     }
+    triangles = surface.mesh;
 
     PCL_INFO("Reconstruction took %g ms\n",tt.toc());
     // Smoothing mesh
@@ -582,7 +655,11 @@ void RoomScanner::polyButtonPressedFunc() {
     meshViewer->setShapeRenderingProperties ( pcl::visualization::PCL_VISUALIZER_SHADING, pcl::visualization::PCL_VISUALIZER_SHADING_PHONG, "mesh" );
     */
 
-    meshViewer->addPolygonMesh(*triangles, "mesh");
+    // memoized or unprocessed mesh is converted once, pipeline output is taken without copy
+    if (!shown) {
+        shown = triangles->toPolyData();
+    }
+    meshViewer->addModelFromPolyData(shown, "mesh");
     ui->qvtkWidget_2->update();
 
     emit(closeLabelSignal(LPOL));
@@ -600,17 +677,20 @@ void RoomScanner::lastFrameToggled() {
         return;
     }
     if (ui->actionShow_captured_frames->isChecked()) {
-        viewer->removePointCloud("frame" + std::to_string(clouds.size()-1));
-        for (size_t i = 0; i < clouds.back()->points.size(); i ++) {
-            clouds.back()->points[i].a = 50;
-        }
-        viewer->addPointCloud(clouds.back(), "frame" + std::to_string(clouds.size()));
+        lodView->hide("frame" + std::to_string(clouds.size()-1));
+        // captured frame is translucent, its points keep their colors
+        lod::style frameStyle;
+        frameStyle.opacity = 0.2;
+        lodView->setStyle("frame" + std::to_string(clouds.size()), frameStyle);
+        PointCloudT::Ptr lastFrame (new PointCloudT);
+        clouds.back()->toCloud(*lastFrame);
+        lodView->show(lastFrame, "frame" + std::to_string(clouds.size()));
         //TODO move camera regarding to position in real world, if is it possible
-        ui->qvtkWidget->update ();
+        lodRefresh();
     }
     else {
-        viewer->removePointCloud("frame" + std::to_string(clouds.size()));
-        ui->qvtkWidget->update ();
+        lodView->hide("frame" + std::to_string(clouds.size()));
+        lodRefresh();
     }
 }
 
@@ -620,8 +700,13 @@ void RoomScanner::actionClearTriggered()
 {
     clouds.clear();
     images.clear();
+    regResult.reset();
+    cache::clear();
+    memo::clear();
+    lodView->clear();
     viewer->removeAllPointClouds();
     meshViewer->removeAllPointClouds();
+    meshViewer->removeAllShapes();
     ui->qvtkWidget->update();
     ui->qvtkWidget_2->update();
     if (sensorConnected) {
@@ -630,6 +715,7 @@ void RoomScanner::actionClearTriggered()
     ui->tabWidget->setCurrentIndex(0);
     stream = true;
     registered = false;
+    volume.reset();
 }
 
 /** \brief runs loading screen and econd thread
@@ -642,19 +728,24 @@ void RoomScanner::regButtonPressed() {
     }
     stream = false;
     PCL_INFO("Registrating %d point clouds.\n", clouds.size());
-    boost::thread* thr = new boost::thread(boost::bind(&RoomScanner::registerNClouds, this));
-
-    labelRegister = new clickLabel(thr);
-    loading(labelRegister);
-    //thr->join();
-    //labelRegister->close();
+    startJob("Registration", &RoomScanner::registerNClouds, labelRegister, LREG);
 }
 
 /** \brief runs registration of frames saved in clouds vector
   */
 void RoomScanner::registerNClouds() {
-    regResult.reset(new PointCloudT);
-    PointCloudT::Ptr source, target;
+    parameters* params = parameters::GetInstance();
+    // temporary clouds of all pairs are reused and freed when registration ends
+    pool::job job("registration");
+    // registered frames go to paged store and volume as they are produced, captured frames are only
+    // decoded, so cancelled or failed registration leaves frames and previous result untouched
+    chunkstore::Ptr registeredStore = resultStore();
+    // frames are decoded one pair at a time, organized frame in sensor coordinates serves image
+    // features and integral normals, its dense copy is moved to model
+    PointCloudT::Ptr source, target, previous;
+    PointCloudT::Ptr frame, previousFrame = pool::cloud();
+    std::vector<int> indices;
+    tsdf::Ptr fused;
 
     registration reg;
     connect(&reg, SIGNAL(regFrameSignal()), this, SLOT(regFrameSlot()));
@@ -662,49 +753,136 @@ void RoomScanner::registerNClouds() {
     Eigen::Matrix4f GlobalTransform = Eigen::Matrix4f::Identity ();
     Eigen::Matrix4f pairTransform1 = Eigen::Matrix4f::Identity ();
     Eigen::Matrix4f pairTransform2 = Eigen::Matrix4f::Identity ();
+    Eigen::Matrix4f framePose = Eigen::Matrix4f::Identity (); // sensor to model transformation of last registered frame
+    Eigen::Matrix4f previousPose = Eigen::Matrix4f::Identity (); // and of the frame before it
+    int fastPath = 0;
+    // frames displayed by level of detail give way to pair being registered
+    lodView->clear();
     viewer->removeAllPointClouds();
-    viewer->addPointCloud(clouds[0], "target");
-    viewer->addPointCloud(clouds[1], "source");
+    clouds[0]->toCloud(*previousFrame);
+    previous = pool::cloud();
+    removeNaNFromPointCloud(*previousFrame, *previous, indices);
+    viewer->addPointCloud(previous, "target");
+    viewer->addPointCloud(PointCloudT::Ptr (new PointCloudT), "source");
 
-    if (texturing::stitchImages(images)) {
-        PCL_INFO("Texture created in file texture.jpg\n");
+    {
+        // texture takes first tenth of progress, pairs share the rest
+        progress::section stitching(0.0, 0.1);
+        if (texturing::stitchImages(images)) {
+            PCL_INFO("Texture created in file texture.jpg\n");
 
-    }
-    else {
-        PCL_INFO("Sorry, no texture\n");
+        }
+        else {
+            PCL_INFO("Sorry, no texture\n");
+        }
     }
 
     pcl::console::TicToc tt;
     tt.tic();
 
-    regResult = clouds[0]; //target 1
+    if (ui->groupBox_11->isChecked()) {
+        // frames are fused into volume instead of concatenating
+        fused.reset(new tsdf(params->TSDFvoxelSize, params->TSDFtruncation));
+        fused->integrate(previous, framePose);
+    }
+    else {
+        registeredStore->insert(*previous);
+    }
     viewer->addText("", 20, 20, "text");
     for (int i = 1; i < clouds.size(); i++) {
         std::string state = "Registrating " + std::to_string(i) + "/" + std::to_string(clouds.size()-1);
         viewer->updateText(state, 10, 20, "text");
-        source = clouds[i];
+        progress::section pair(0.1 + 0.9 * (i - 1) / (clouds.size() - 1), 0.1 + 0.9 * i / (clouds.size() - 1));
+        progress::update(0.0, state);
+        progress::check();
+        frame = pool::cloud();
+        clouds[i]->toCloud(*frame);
+        source = pool::cloud();
+        removeNaNFromPointCloud(*frame, *source, indices);
         PCL_INFO ("source %d\n", source->points.size());
-        target = clouds[i-1];
+        if (fused) {
+            // frame-to-model: align to synthetic view of model from last pose
+            target = pool::cloud();
+            fused->raycast(framePose, params->TSDFwidth, params->TSDFheight, *target);
+            removeNaNFromPointCloud(*target, *target, indices);
+        }
+        else {
+            target = previous;
+        }
         pcl::transformPointCloud (*source, *source, GlobalTransform);
         viewer->updatePointCloud(target, "target");
         viewer->updatePointCloud(source, "source");
 
+        // seed with constant velocity prediction, skip feature matching if it already fits
+        bool coarseFound = false;
+        int iterations = 100;
+        Eigen::Matrix4f seed = Eigen::Matrix4f::Identity ();
+        if (ui->groupBox_15->isChecked()) {
+            Eigen::Matrix4f predicted = framePose * previousPose.inverse () * framePose;
+            seed = predicted * GlobalTransform.inverse ();
+            pcl::transformPointCloud (*source, *source, seed);
+            double fitness = registration::seedFitness(source, target, params->PRIORmaxDist);
+            PCL_INFO("Motion prior fitness %g\n", fitness);
+            if (fitness >= params->PRIORminFitness) {
+                pairTransform1 = seed;
+                iterations = params->PRIORiterations;
+                coarseFound = true;
+                fastPath++;
+            }
+        }
+
+        // image features and integral normals need both frames organized
+        const bool organized = frame->isOrganized() && previousFrame->isOrganized();
+
+        // estimate transformation from image features of organized frames, model pose of previous frame is known
+        if (!coarseFound && ui->groupBox_14->isChecked() && organized) {
+            Eigen::Matrix4f orbTransform;
+            if (registration::computeTransformationORB(frame, previousFrame, orbTransform)) {
+                pairTransform1 = framePose * orbTransform * GlobalTransform.inverse ();
+                pcl::transformPointCloud (*source, *source, Eigen::Matrix4f (pairTransform1 * seed.inverse ()));
+                coarseFound = true;
+            }
+            else {
+                PCL_INFO("ORB alignment failed, falling back to fpfh\n");
+            }
+        }
+
         // estimate transformation using fpfh features
-        if (!reg.computeTransformation(source, target, pairTransform1))  {
-            //labelRegister->close();
-            emit(closeLabelSignal(LREG));
-            QMessageBox::warning(this, "Error", "Error occured! Stopping registration.");
-            viewer->removeShape("text");
-            return;
+        if (!coarseFound) {
+            progress::section coarse(0.0, 0.3);
+            // source was moved by global transform and seed, target of frame-to-frame is at pose of previous frame
+            const bool frameTarget = organized && !fused;
+            if (!reg.computeTransformation(source, target, pairTransform1, organized ? frame : PointCloudT::Ptr (), Eigen::Matrix4f (seed * GlobalTransform),
+                                           frameTarget ? previousFrame : PointCloudT::Ptr (), framePose))  {
+                //labelRegister->close();
+                emit(closeLabelSignal(LREG));
+                QMessageBox::warning(this, "Error", "Error occured! Stopping registration.");
+                viewer->removeShape("text");
+                return;
+            }
+            pairTransform1 = pairTransform1 * seed;
         }
 
-        PointCloudT::Ptr temp (new PointCloudT);
+        // coarse alignment is done, icp takes the rest of the pair
+        progress::check();
+        progress::section alignment(0.3, 1.0);
+        PointCloudT::Ptr temp = pool::cloud();
         //get transformation between two clouds and transformed source
-        reg.pairAlign (source, target, temp, pairTransform2, true);
+        reg.pairAlign (source, target, temp, pairTransform2, true, iterations);
         //pcl::transformPointCloud (*temp, *target, GlobalTransform);
         pcl::copyPointCloud (*temp, *source);
-        *regResult += *source;
-        filters::voxelGridFilter(regResult, regResult, 0.02);
+        previousPose = framePose;
+        framePose = pairTransform2 * pairTransform1 * GlobalTransform;
+        if (fused) {
+            PointCloudT::Ptr sensorFrame = pool::cloud();
+            pcl::transformPointCloud (*source, *sensorFrame, Eigen::Matrix4f (framePose.inverse ()));
+            fused->integrate(sensorFrame, framePose);
+        }
+        else {
+            registeredStore->insert(*source);
+        }
+        previous = source;
+        previousFrame = frame;
         ui->qvtkWidget->update();
 
         //update the global transform
@@ -712,14 +890,29 @@ void RoomScanner::registerNClouds() {
 
     }
     viewer->removeShape("text");
+    if (fused) {
+        PointCloudT::Ptr extracted = pool::cloud();
+        fused->extractCloud(*extracted);
+        registeredStore->insert(*extracted);
+    }
+    else {
+        // voxels never cross chunk borders when chunk size is multiple of leaf
+        registeredStore->apply(boost::bind(&filters::voxelGridFilter, _1, _2, 0.02f));
+    }
+    // results of finished registration replace previous ones together
+    regResult = registeredStore;
+    volume = fused;
     PCL_INFO("Registration took %g ms\n",tt.toc());
+    if (ui->groupBox_15->isChecked()) {
+        PCL_INFO("Motion prior was good enough for %d of %d frames\n", fastPath, clouds.size()-1);
+    }
 
     viewer->removeAllPointClouds();
 
     //filters::normalFilter(regResult, regResult);
-    viewer->addPointCloud(regResult, "result");
+    showResult("result");
     //pcl::io::savePCDFileBinary ("registeredOutput.pcd", *regResult);
-    PCL_INFO( "Registrated Point Cloud has %d points.\n", regResult->points.size());
+    PCL_INFO( "Registrated Point Cloud has %d points.\n", regResult->size());
 
     ui->qvtkWidget->update();
     registered = true;
@@ -749,7 +942,7 @@ void RoomScanner::keypointsToggled() {
     }
     else {
         viewer->addPointCloud(key_cloud, "keypoints");
-        viewer->setPointCloudRenderingProperties (pcl::visualization::PCL_VISUALIZER_POINT_SIZE, 10, "keypoints");
+        lodView->applyStyle("keypoints");
         ui->qvtkWidget->update();
     }
 }
@@ -775,6 +968,7 @@ void RoomScanner::regFrameSlot() {
   */
 void RoomScanner::streamButtonPressed() {
     stream = true;
+    lodView->clear();
     viewer->removeAllPointClouds();
     viewer->addPointCloud(kinectCloud, "kinectCloud");
     emit(resetCameraSignal());
@@ -785,9 +979,7 @@ void RoomScanner::actionSmoothTriggered() {
         QMessageBox::warning(this, "Error", "Nothing to smooth!");
         PCL_INFO("Nothing to smooth\n");
     }
-    boost::thread* thr2 = new boost::thread(boost::bind(&RoomScanner::smoothAction, this));
-    labelSmooth = new clickLabel(thr2);
-    loading(labelSmooth);
+    startJob("Smoothing", &RoomScanner::smoothAction, labelSmooth, LSMO);
 }
 
 /** \brief smooth input cloud
@@ -795,23 +987,40 @@ void RoomScanner::actionSmoothTriggered() {
 void RoomScanner::smoothAction() {
     stream = false;
     PCL_INFO("Smoothing input cloud\n");
+    pool::job job("smoothing");
+    // displayed clouds are smoothed in place
+    lodView->clear();
 
     pcl::console::TicToc tt;
     tt.tic();
 
     if (!clouds.empty()) {
         if (registered){
-            filters::voxelGridFilter(regResult, regResult, 0.02);
-            filters::cloudSmoothMLS(regResult, regResult);
-            filters::normalFilter(regResult, regResult);
+            parameters* params = parameters::GetInstance();
+            chunkstore::Ptr smoothed = resultStore();
+            if (regResult->size() * sizeof(PointT) > params->CHUNKbudget * 1024 * 1024) {
+                // stream through chunks paged to disk
+                PCL_INFO("Cloud exceeds memory budget, smoothing by chunks\n");
+                regResult->process(&filters::smoothCloud, filters::smoothHalo(), *smoothed);
+            }
+            else {
+                PointCloudT::Ptr cloud = pool::cloud();
+                regResult->extract(*cloud);
+                filters::smoothCloud(cloud, cloud);
+                smoothed->insert(*cloud);
+            }
+            regResult = smoothed;
             viewer->removeAllPointClouds();
-            viewer->addPointCloud(regResult, "smoothCloud");
+            showResult("smoothCloud");
         }
         else {
-            filters::voxelGridFilter(clouds.back(), clouds.back(), 0.02);
-            filters::cloudSmoothMLS(clouds.back(), clouds.back());
+            PointCloudT::Ptr lastFrame (new PointCloudT);
+            clouds.back()->toCloud(*lastFrame);
+            filters::voxelGridFilter(lastFrame, lastFrame, 0.02);
+            filters::cloudSmoothMLS(lastFrame, lastFrame);
+            clouds.back().reset(new compactCloud (*lastFrame, parameters::GetInstance()->COMPACTresolution));
             viewer->removeAllPointClouds();
-            viewer->addPointCloud(clouds.back(), "smoothCloud");
+            lodView->show(lastFrame, "smoothCloud");
         }
     }
     PCL_INFO("Smoothing took %g ms\n",tt.toc());
@@ -823,42 +1032,33 @@ void RoomScanner::smoothAction() {
 
 }
 
-/** \brief load paramters from config file and update gui form
+/** \brief Creates empty store of registered points, each store pages to its own file and gets
+  * half of memory budget so previous result fits beside it while a stage runs
+  * \return empty store
   */
-void RoomScanner::loadConfigFile() {
+chunkstore::Ptr RoomScanner::resultStore() {
     parameters* params = parameters::GetInstance();
-    std::ifstream config_file("config.json");
-
-    if (!config_file.fail()) {
-        PCL_INFO("Config file loaded\n");
-        using boost::property_tree::ptree;
-        ptree pt;
-        read_json(config_file, pt);
-
-        for (auto & array_element: pt) {
-                PCL_INFO("%s\n", array_element.first.c_str());
-            for (auto & property: array_element.second) {
-                PCL_INFO(" %s = %s\n", property.first.c_str(), property.second.get_value < std::string > ().c_str());
-            }
-            PCL_INFO("\n");
-        }
-
+    const std::string path = params->CHUNKpath + "_result" + std::to_string(storeCount++) + ".bin";
+    return chunkstore::Ptr (new chunkstore(params->CHUNKsize, params->CHUNKbudget * 512 * 1024, path));
+}
 
-        params->VGFleafSize = pt.get<float>("gridFilter.leafSize");
+/** \brief shows registered points, store bigger than memory budget is shown by evenly strided subset
+  * \param id name of cloud in viewer
+  */
+void RoomScanner::showResult(const std::string &id) {
+    parameters* params = parameters::GetInstance();
+    PointCloudT::Ptr shown (new PointCloudT);
+    regResult->sample(params->CHUNKbudget * 1024 * 1024 / sizeof(PointT), *shown);
+    lodView->show(shown, id);
+}
 
+/** \brief load paramters from config file and update gui form
+  */
+void RoomScanner::loadConfigFile() {
+    parameters* params = parameters::GetInstance();
+    if (loadParameters("config.json")) {
         ui->lineEdit_VGleaf->setText(QString::number(params->VGFleafSize));
 
-
-        params->MLSpolynomialOrder = pt.get<int>("mls.polynomialOrder");
-        params->MLSusePolynomialFit = pt.get<bool>("mls.usePolynomialFit");
-        params->MLSsearchRadius = pt.get<double>("mls.searchRadius");
-        params->MLSsqrGaussParam = pt.get<double>("mls.sqrGaussParam");
-        params->MLSupsamplingRadius = pt.get<double>("mls.upsamplingRadius");
-        params->MLSupsamplingStepSize = pt.get<double>("mls.upsamplingStepSize");
-        params->MLSdilationIterations = pt.get<int>("mls.dilationIterations");
-        params->MLSdilationVoxelSize = pt.get<double>("mls.dilationVoxelSize");
-        params->MLScomputeNormals = pt.get<bool>("mls.computeNormals");
-
         ui->lineEdit_MLSorder->setText(QString::number(params->MLSpolynomialOrder));
         ui->lineEdit_MLSradius->setText(QString::number(params->MLSsearchRadius));
         ui->lineEdit_MLSgauss->setText(QString::number(params->MLSsqrGaussParam));
@@ -868,64 +1068,66 @@ void RoomScanner::loadConfigFile() {
         ui->lineEdit_MLSdvsize->setText(QString::number(params->MLSdilationVoxelSize));
         ui->checkBox_MLSnormals->setChecked(params->MLScomputeNormals);
         ui->checkBox_MLSpolyfit->setChecked(params->MLSusePolynomialFit);
-
-
-        params->GPsearchRadius = pt.get<double>("greedyProjection.searchRadius");
-        params->GPmu = pt.get<double>("greedyProjection.mu");
-        params->GPmaximumNearestNeighbors = pt.get<int>("greedyProjection.maximumNearestNeighbors");
+        ui->lineEdit_MLStile->setText(QString::number(params->MLStileSize));
+        ui->lineEdit_MLSmemory->setText(QString::number(params->MLSmemoryLimit));
 
         ui->lineEdit_GPserrad->setText(QString::number(params->GPsearchRadius));
         ui->lineEdit_GPmaxneigh->setText(QString::number(params->GPmaximumNearestNeighbors));
         ui->lineEdit_GPmu->setText(QString::number(params->GPmu));
 
-
-        params->SIFTmin_scale = pt.get<double>("SIFT.min_scale");
-        params->SIFTn_octaves = pt.get<int>("SIFT.n_octaves");
-        params->SIFTn_scales_per_octave = pt.get<int>("SIFT.n_scales_per_octave");
-        params->SIFTmin_contrast = pt.get<double>("SIFT.min_contrast");
-
         ui->lineEdit_SIFTmin_con->setText(QString::number(params->SIFTmin_contrast));
         ui->lineEdit_SIFTmin_scale->setText(QString::number(params->SIFTmin_scale));
         ui->lineEdit_SIFTn_octaves->setText(QString::number(params->SIFTn_octaves));
         ui->lineEdit_SIFTscales->setText(QString::number(params->SIFTn_scales_per_octave));
 
-
-        params->REGnormalsRadius = pt.get<double>("registration.normalsRadius");
-        params->REGfpfh = pt.get<double>("registration.fpfh");
-        params->REGreject = pt.get<double>("registration.reject");
-        params->REGcorrDist = pt.get<double>("registration.corrDist");
+        ui->lineEdit_KEYdetector->setText(QString::fromStdString(params->KEYdetector));
+        ui->lineEdit_KEYuniform->setText(QString::number(params->KEYuniformRadius));
+        ui->lineEdit_ISSsalient->setText(QString::number(params->ISSsalientRadius));
+        ui->lineEdit_ISSnonMax->setText(QString::number(params->ISSnonMaxRadius));
+        ui->lineEdit_HARradius->setText(QString::number(params->HARradius));
+        ui->lineEdit_HARthreshold->setText(QString::number(params->HARthreshold));
 
         ui->lineEdit_REGcorrejdist->setText(QString::number(params->REGreject));
         ui->lineEdit_REGfpfh->setText(QString::number(params->REGfpfh));
         ui->lineEdit_REGmaxCorrDist->setText(QString::number(params->REGcorrDist));
         ui->lineEdit_REGnormals->setText(QString::number(params->REGnormalsRadius));
 
+        ui->lineEdit_ORBfeatures->setText(QString::number(params->ORBfeatures));
+        ui->lineEdit_ORBinliers->setText(QString::number(params->ORBminInliers));
+        ui->lineEdit_ORBthreshold->setText(QString::number(params->ORBinlierThreshold));
 
-        params->FBFsigmaS = pt.get<double>("fastBFilter.sigmaS");
-        params->FBFsigmaR = pt.get<double>("fastBFilter.sigmaR");
+        ui->lineEdit_PRIORdist->setText(QString::number(params->PRIORmaxDist));
+        ui->lineEdit_PRIORfitness->setText(QString::number(params->PRIORminFitness));
+        ui->lineEdit_PRIORiter->setText(QString::number(params->PRIORiterations));
 
-        ui->lineEdit_FBSigmaR->setText(QString::number(params->FBFsigmaR));
-        ui->lineEdit_FBSigmaS->setText(QString::number(params->FBFsigmaS));
+        ui->groupBox_16->setChecked(params->OUTfast);
+        ui->lineEdit_OUTwindow->setText(QString::number(params->OUTwindow));
+        ui->lineEdit_OUTneighbors->setText(QString::number(params->OUTminNeighbors));
 
+        ui->lineEdit_PREcapture->setText(QString::fromStdString(params->PREcapture));
+        ui->lineEdit_PREload->setText(QString::fromStdString(params->PREload));
 
-        params->DECtargetReductionFactor = pt.get<double>("decimation.targetReductionFactor");
+        ui->lineEdit_FBSigmaR->setText(QString::number(params->FBFsigmaR));
+        ui->lineEdit_FBSigmaS->setText(QString::number(params->FBFsigmaS));
 
         ui->lineEdit_DECfactor->setText(QString::number(params->DECtargetReductionFactor));
 
-
-        params->HOLsize = pt.get<double>("holeFill.size");
-
         ui->lineEdit_HOLsize->setText(QString::number(params->HOLsize));
 
-
-        params->GRres = pt.get<double>("gridProj.size");
-
         ui->lineEdit_GRres->setText(QString::number(params->GRres));
 
+        ui->lineEdit_POSdepth->setText(QString::number(params->POSdepth));
 
-        params->POSdepth = pt.get<int>("poissonProj.depth");
+        ui->lineEdit_MCres->setText(QString::number(params->MCresolution));
+        ui->lineEdit_MCdist->setText(QString::number(params->MCdistIgnore));
 
-        ui->lineEdit_POSdepth->setText(QString::number(params->POSdepth));
+        ui->lineEdit_TSDFvoxel->setText(QString::number(params->TSDFvoxelSize));
+        ui->lineEdit_TSDFtrunc->setText(QString::number(params->TSDFtruncation));
+        ui->lineEdit_TSDFweight->setText(QString::number(params->TSDFmaxWeight));
+
+        ui->groupBox_18->setChecked(params->NORintegral);
+        ui->lineEdit_NORsmoothing->setText(QString::number(params->NORsmoothing));
+        ui->lineEdit_NORdepth->setText(QString::number(params->NORmaxDepthChange));
     }
 }
 
@@ -946,6 +1148,8 @@ void RoomScanner::refreshParams() {
     params->MLSdilationIterations = ui->lineEdit_MLSditer->text().toInt();
     params->MLSdilationVoxelSize = ui->lineEdit_MLSdvsize->text().toDouble();
     params->MLScomputeNormals = ui->checkBox_MLSnormals->isChecked();
+    params->MLStileSize = ui->lineEdit_MLStile->text().toDouble();
+    params->MLSmemoryLimit = ui->lineEdit_MLSmemory->text().toDouble();
 
 
     params->GPsearchRadius = ui->lineEdit_GPserrad->text().toDouble();
@@ -959,12 +1163,44 @@ void RoomScanner::refreshParams() {
     params->SIFTmin_contrast = ui->lineEdit_SIFTmin_con->text().toDouble();
 
 
+    params->KEYdetector = ui->lineEdit_KEYdetector->text().toStdString();
+    params->KEYuniformRadius = ui->lineEdit_KEYuniform->text().toDouble();
+    params->ISSsalientRadius = ui->lineEdit_ISSsalient->text().toDouble();
+    params->ISSnonMaxRadius = ui->lineEdit_ISSnonMax->text().toDouble();
+    params->HARradius = ui->lineEdit_HARradius->text().toDouble();
+    params->HARthreshold = ui->lineEdit_HARthreshold->text().toDouble();
+
+
     params->REGnormalsRadius = ui->lineEdit_REGnormals->text().toDouble();
     params->REGfpfh = ui->lineEdit_REGfpfh->text().toDouble();
     params->REGreject = ui->lineEdit_REGcorrejdist->text().toDouble();
     params->REGcorrDist = ui->lineEdit_REGmaxCorrDist->text().toDouble();
 
 
+    params->ORBfeatures = ui->lineEdit_ORBfeatures->text().toInt();
+    params->ORBminInliers = ui->lineEdit_ORBinliers->text().toInt();
+    params->ORBinlierThreshold = ui->lineEdit_ORBthreshold->text().toDouble();
+
+
+    params->PRIORmaxDist = ui->lineEdit_PRIORdist->text().toDouble();
+    params->PRIORminFitness = ui->lineEdit_PRIORfitness->text().toDouble();
+    params->PRIORiterations = ui->lineEdit_PRIORiter->text().toInt();
+
+
+    params->OUTfast = ui->groupBox_16->isChecked();
+    params->OUTwindow = ui->lineEdit_OUTwindow->text().toInt();
+    params->OUTminNeighbors = ui->lineEdit_OUTneighbors->text().toInt();
+
+
+    params->NORintegral = ui->groupBox_18->isChecked();
+    params->NORsmoothing = ui->lineEdit_NORsmoothing->text().toDouble();
+    params->NORmaxDepthChange = ui->lineEdit_NORdepth->text().toDouble();
+
+
+    params->PREcapture = ui->lineEdit_PREcapture->text().toStdString();
+    params->PREload = ui->lineEdit_PREload->text().toStdString();
+
+
     params->FBFsigmaS = ui->lineEdit_FBSigmaS->text().toDouble();
     params->FBFsigmaR = ui->lineEdit_FBSigmaR->text().toDouble();
 
@@ -981,6 +1217,15 @@ void RoomScanner::refreshParams() {
     params->POSdepth = ui->lineEdit_POSdepth->text().toInt();
 
 
+    params->MCresolution = ui->lineEdit_MCres->text().toDouble();
+    params->MCdistIgnore = ui->lineEdit_MCdist->text().toDouble();
+
+
+    params->TSDFvoxelSize = ui->lineEdit_TSDFvoxel->text().toDouble();
+    params->TSDFtruncation = ui->lineEdit_TSDFtrunc->text().toDouble();
+    params->TSDFmaxWeight = ui->lineEdit_TSDFweight->text().toDouble();
+
+
     PCL_INFO("Parameters refreshed.\n");
     ui->tabWidget->setCurrentIndex(0);
 }
@@ -988,7 +1233,7 @@ void RoomScanner::refreshParams() {
 /** \brief save output mesh to file
   */
 void RoomScanner::saveModelButtonPressed() {
-    if (triangles == NULL || triangles->polygons.size() == 0) {
+    if (triangles == NULL || triangles->triangleCount() == 0) {
         PCL_INFO("Nothing to save\n");
         return;
     }
@@ -1000,13 +1245,15 @@ void RoomScanner::saveModelButtonPressed() {
         fileName = dialog.selectedFiles().at(0);
     if (fileName.contains(".")) {
         std::string extension = fileName.split(".",QString::SkipEmptyParts).at(1).toUtf8().constData();
+        pcl::PolygonMesh model;
+        triangles->toPolygonMesh(model);
         if (extension.compare("ply") == 0) {
             PCL_INFO("Saving %s\n",  fileName.toUtf8().constData());
-            pcl::io::savePLYFile(fileName.toUtf8().constData(), *triangles);
+            pcl::io::savePLYFile(fileName.toUtf8().constData(), model);
         }
         else if (extension.compare("obj") == 0) {
             PCL_INFO("Saving %s\n",  fileName.toUtf8().constData());
-            pcl::io::saveOBJFile(fileName.toUtf8().constData(), *triangles);
+            pcl::io::saveOBJFile(fileName.toUtf8().constData(), model);
         }
         else {
             PCL_INFO("Unsupported format.\n");
@@ -1084,7 +1331,7 @@ void RoomScanner::saveRegFrame() {
         }
         else {
             PCL_INFO("Saving %s\n",  fileName.toUtf8().constData());
-            pcl::io::savePCDFile(fileName.toUtf8().constData(), *regResult);
+            regResult->save(fileName.toUtf8().constData());
         }
     }
     else {
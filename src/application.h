@@ -69,6 +69,14 @@
 #include "registration.h"
 #include "texturing.h"
 #include "clicklabel.h"
+#include "tsdf.h"
+#include "chunkstore.h"
+#include "compact.h"
+#include "pool.h"
+#include "memo.h"
+#include "progress.h"
+#include "lod.h"
+#include "trimesh.h"
 
 namespace Ui
 {
@@ -87,15 +95,20 @@ public:
     void cloudSmooth(PointCloudT::Ptr cloudToSmooth, PointCloudT::Ptr output);
     void polyButtonPressedFunc();
     void loading(clickLabel* label);
+    void startJob(const std::string &name, void (RoomScanner::*function)(), clickLabel* &label, int index);
+    void runJob(progress::Ptr job, void (RoomScanner::*function)(), int index);
     void registerNClouds();
     void saveButtonPressedFun();
     void smoothAction();
+    chunkstore::Ptr resultStore();
+    void showResult(const std::string &id);
     //void loadActionPressedFun();
     void keyboardEventOccurred (const pcl::visualization::KeyboardEvent &event, void* viewer_void);
 
 signals:
     void closeLabelSignal(int);
     void resetCameraSignal();
+    void frameSavedSignal();
 
 public slots:
     void resetButtonPressed(void);
@@ -138,20 +151,26 @@ public slots:
 
     void resetCameraSlot();
 
+    void lodRefresh();
+
     void saveRegFrame();
 
 protected:
     boost::shared_ptr<pcl::visualization::PCLVisualizer> viewer;
     boost::shared_ptr<pcl::visualization::PCLVisualizer> meshViewer;
+    lod::Ptr lodView; // level of detail of clouds in viewer
     PointCloudT::Ptr kinectCloud;
     PointCloudT::Ptr registratedCloud;
     PointCloudAT::Ptr key_cloud;
-    PointCloudT::Ptr regResult;
-    std::vector<PointCloudT::Ptr> clouds;
+    chunkstore::Ptr regResult; // registered points paged by chunks, never held whole in memory
+    int storeCount = 0;
+    std::vector<compactCloud::Ptr> clouds; // preprocessed frames quantized at rest, organized frames keep pixel grid
     std::vector<std::string> images;
     QTimer *tmrTimer;
+    QTimer *lodTimer;
     QMovie *movie;
-    pcl::PolygonMesh::Ptr triangles;
+    trimesh::Ptr triangles;
+    tsdf::Ptr volume;
 
     unsigned int red;
     unsigned int green;
@@ -160,8 +179,8 @@ protected:
     boost::atomic<bool> stream;
     bool copying;
     bool stop;
-    int cloudWidth;
-    int cloudHeight;
+    int cloudWidth = 0;
+    int cloudHeight = 0;
     std::vector<float> cloudX, cloudY, cloudZ;
     std::vector<unsigned long> cloudRGB;
     boost::mutex mtx_;
@@ -0,0 +1,92 @@
+/*
+    This file is part of RoomScanner.
+
+    RoomScanner is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    RoomScanner is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with RoomScanner.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "keypoints.h"
+#include "filters.h"
+#include <random>
+#include <string>
+#include <cmath>
+#include <algorithm>
+
+// Checks registered in ctest: parallel detectors and filters against pcl on generated room,
+// so they run without recorded pcd files.
+
+namespace {
+
+/** \brief Generates colored box room merged from several views,
+  * fixed seed gives the same cloud on every run
+  * \param cloud resultant cloud
+  * \param spacing distance of samples on walls in one view
+  * \param views number of merged views, each samples all walls with own offset and depth noise
+  */
+void syntheticRoom(PointCloudT &cloud, float spacing, int views) {
+    // walls, floor and ceiling of 4 x 3 x 2.5 m room
+    const float size[3] = {4.0f, 3.0f, 2.5f};
+    std::mt19937 random(42);
+    std::uniform_real_distribution<float> offset(0.0f, spacing);
+    std::normal_distribution<float> noise(0.0f, 0.002f);
+
+    cloud.points.clear();
+    for (int v = 0; v < views; v++) {
+        for (int face = 0; face < 6; face++) {
+            const int normal = face / 2, u = (normal + 1) % 3, w = (normal + 2) % 3;
+            const float du = offset(random), dw = offset(random);
+            for (float a = du; a < size[u]; a += spacing) {
+                for (float b = dw; b < size[w]; b += spacing) {
+                    // stripes, checkers and fine pattern give intensity changes on several scales
+                    const float pattern = 0.35f * std::sin(3.0f * a + face) * std::sin(4.0f * b) +
+                                          0.2f * ((static_cast<int>(std::floor(2.0f * a)) + static_cast<int>(std::floor(2.0f * b))) % 2) +
+                                          0.1f * std::sin(40.0f * a) * std::sin(30.0f * b);
+                    const uint8_t value = static_cast<uint8_t>(std::min(255.0f, std::max(0.0f, 100.0f + 150.0f * pattern)));
+                    PointT p;
+                    float *position = p.data;
+                    position[normal] = (face % 2) * size[normal] + noise(random);
+                    position[u] = a;
+                    position[w] = b;
+                    p.r = value;
+                    p.g = static_cast<uint8_t>(value * 0.9f);
+                    p.b = static_cast<uint8_t>(value * 0.8f);
+                    cloud.points.push_back(p);
+                }
+            }
+        }
+    }
+    cloud.width = cloud.points.size();
+    cloud.height = 1;
+    cloud.is_dense = true;
+}
+
+}
+
+/** \brief Runs one check
+  * \param argv keypoints or voxel
+  * \return 0 if parallel and pcl results agree
+  */
+int main(int argc, char *argv[]) {
+    loadParameters("config.json");
+    const std::string check = argc > 1 ? argv[1] : "";
+    PointCloudT::Ptr room(new PointCloudT);
+    if (check == "keypoints") {
+        syntheticRoom(*room, 0.02f, 1);
+        return keypoints::benchmark(room, "generated room") == 0 ? 0 : 1;
+    }
+    if (check == "voxel") {
+        syntheticRoom(*room, 0.01f, 3);
+        return filters::benchmarkVoxelGrid(room, "generated room", 0.02f) ? 0 : 1;
+    }
+    PCL_ERROR("Usage: %s keypoints|voxel\n", argv[0]);
+    return 1;
+}
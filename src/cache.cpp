@@ -0,0 +1,263 @@
+/*
+    This file is part of RoomScanner.
+
+    RoomScanner is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    RoomScanner is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with RoomScanner.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "cache.h"
+#include <pcl/common/time.h>
+#include <pcl/common/io.h>
+#include <pcl/filters/filter.h>
+#include <cstring>
+
+std::mutex cache::normalMutex;
+std::list<cache::normalEntry> cache::normalEntries;
+std::mutex cache::treeMutex;
+std::list<cache::treeEntry> cache::treeEntries;
+size_t cache::hits = 0;
+size_t cache::misses = 0;
+
+namespace {
+
+// deleter of pointer which does not own the cloud
+struct keepCloud {
+    void operator()(const PointCloudT *) const {}
+};
+
+}
+
+/** \brief Hashes coordinates of all points, chunks are hashed in parallel and combined in order
+  * \param cloud input cloud
+  * \return size and hash of cloud
+  */
+cache::fingerprint cache::compute(const PointCloudT &cloud) {
+    const int size = cloud.points.size();
+    const int chunkSize = 65536;
+    const int chunks = (size + chunkSize - 1) / chunkSize;
+    std::vector<uint64_t> chunkHashes(chunks);
+#pragma omp parallel for
+    for (int c = 0; c < chunks; c++) {
+        // FNV-1a over bits of coordinates
+        uint64_t hash = 14695981039346656037ull;
+        for (int i = c * chunkSize; i < std::min(size, (c + 1) * chunkSize); i++) {
+            uint32_t bits[3];
+            std::memcpy(bits, cloud.points[i].data, sizeof(bits));
+            for (int j = 0; j < 3; j++) {
+                hash = (hash ^ bits[j]) * 1099511628211ull;
+            }
+        }
+        chunkHashes[c] = hash;
+    }
+    fingerprint result;
+    result.size = size;
+    result.hash = 14695981039346656037ull;
+    for (int c = 0; c < chunks; c++) {
+        result.hash = (result.hash ^ chunkHashes[c]) * 1099511628211ull;
+    }
+    return result;
+}
+
+/** \brief Returns normals and curvature of cloud, computed only if not cached for same content and neighborhood,
+  * organized cloud takes integral image fast path if enabled, its normals are NaN at invalid pixels and depth edges
+  * \param cloud input cloud
+  * \param k number of nearest neighbors, radius search is used if zero
+  * \param radius of neighborhood if k is zero
+  * \param viewpoint normals are flipped towards
+  * \return shared normals, must not be modified
+  */
+cache::NormalCloud::ConstPtr cache::normals(const PointCloudT::ConstPtr &cloud, int k, float radius, const Eigen::Vector3f &viewpoint) {
+    parameters* params = parameters::GetInstance();
+    const fingerprint key = compute(*cloud);
+    const bool integral = params->NORintegral && cloud->isOrganized();
+    float depthChange = 0.0f;
+    if (integral) {
+        k = 0;
+        radius = params->NORsmoothing;
+        depthChange = params->NORmaxDepthChange;
+    }
+    else if (k > 0) {
+        radius = 0.0f;
+    }
+    {
+        std::lock_guard<std::mutex> lock(normalMutex);
+        for (std::list<normalEntry>::iterator it = normalEntries.begin(); it != normalEntries.end(); ++it) {
+            if (it->cloud == key && it->integral == integral && it->k == k && it->radius == radius &&
+                    it->depthChange == depthChange && it->viewpoint == viewpoint) {
+                normalEntries.splice(normalEntries.begin(), normalEntries, it);
+                hits++;
+                PCL_INFO("Normals of %d points taken from cache (%d hits, %d misses)\n", key.size, hits, misses);
+                return it->normals;
+            }
+        }
+    }
+
+    pcl::console::TicToc tt;
+    tt.tic();
+    NormalCloud::Ptr result (new NormalCloud ());
+    if (integral) {
+        pcl::IntegralImageNormalEstimation<PointT, pcl::Normal> ne;
+        ne.setNormalEstimationMethod (ne.COVARIANCE_MATRIX);
+        ne.setMaxDepthChangeFactor (depthChange);
+        ne.setNormalSmoothingSize (radius);
+        ne.setViewPoint (viewpoint[0], viewpoint[1], viewpoint[2]);
+        ne.setInputCloud (cloud);
+        ne.compute (*result);
+    }
+    else {
+        pcl::NormalEstimationOMP<PointT, pcl::Normal> ne;
+        ne.setInputCloud (cloud);
+        ne.setSearchMethod (kdtree (cloud));
+        if (k > 0) {
+            ne.setKSearch (k);
+        }
+        else {
+            ne.setRadiusSearch (radius);
+        }
+        ne.setViewPoint (viewpoint[0], viewpoint[1], viewpoint[2]);
+        ne.compute (*result);
+    }
+
+    // another thread may have computed same normals meanwhile, both results are equal
+    std::lock_guard<std::mutex> lock(normalMutex);
+    misses++;
+    PCL_INFO("Normals of %d points computed %sin %g ms (%d hits, %d misses)\n", key.size, integral ? "from integral images " : "", tt.toc(), hits, misses);
+    if (params->CACHEnormals > 0) {
+        normalEntry entry = {key, integral, k, radius, depthChange, viewpoint, result};
+        normalEntries.push_front(entry);
+        while (normalEntries.size() > static_cast<size_t>(params->CACHEnormals)) {
+            normalEntries.pop_back();
+        }
+    }
+    return result;
+}
+
+/** \brief Returns normals flipped towards sensor origin of cloud like pcl::NormalEstimation does
+  * \param cloud input cloud
+  * \param k number of nearest neighbors, radius search is used if zero
+  * \param radius of neighborhood if k is zero
+  * \return shared normals, must not be modified
+  */
+cache::NormalCloud::ConstPtr cache::normals(const PointCloudT::ConstPtr &cloud, int k, float radius) {
+    return normals(cloud, k, radius, cloud->sensor_origin_.head<3>());
+}
+
+/** \brief Returns copy of cloud with normals, points without valid normal are left out
+  * so result can be used by consumers of unorganized clouds
+  * \param cloud input cloud
+  * \param k number of nearest neighbors, radius search is used if zero
+  * \param radius of neighborhood if k is zero
+  * \return cloud with normals
+  */
+PointCloudRGBNT::Ptr cache::withNormals(const PointCloudT::ConstPtr &cloud, int k, float radius) {
+    NormalCloud::ConstPtr cloudNormals = normals(cloud, k, radius);
+    PointCloudRGBNT::Ptr result (new PointCloudRGBNT);
+    pcl::concatenateFields (*cloud, *cloudNormals, *result);
+    if (!result->is_dense || cloud->isOrganized()) {
+        std::vector<int> indices;
+        pcl::removeNaNNormalsFromPointCloud (*result, *result, indices);
+    }
+    return result;
+}
+
+/** \brief Returns kd-tree built on this cloud object, tree is built on first borrow
+  * and rebuilt if any coordinate of the cloud was modified since, in-place filters need no
+  * explicit invalidation. Trees are built outside of the lock, concurrent borrowers of same cloud
+  * wait for one tree. Tree must not be handed to pcl::Feature with another search surface,
+  * its initCompute calls setInputCloud on the shared tree
+  * \param cloud input cloud
+  * \return shared tree, keeps the cloud alive, its input cloud must not be changed
+  */
+pcl::search::KdTree<PointT>::Ptr cache::kdtree(const PointCloudT::ConstPtr &cloud) {
+    parameters* params = parameters::GetInstance();
+    // full hash, one changed point makes the tree stale
+    const fingerprint key = compute(*cloud);
+    std::shared_future<pcl::search::KdTree<PointT>::Ptr> found;
+    std::promise<pcl::search::KdTree<PointT>::Ptr> building;
+    bool build = true;
+    {
+        std::lock_guard<std::mutex> lock(treeMutex);
+        std::list<treeEntry>::iterator it = treeEntries.begin();
+        while (it != treeEntries.end()) {
+            if (it->cloud.expired()) {
+                // released cloud takes its tree along
+                it = treeEntries.erase(it);
+            }
+            else if (it->address == cloud.get()) {
+                if (it->content == key) {
+                    found = it->tree;
+                    build = false;
+                    treeEntries.splice(treeEntries.begin(), treeEntries, it);
+                }
+                else {
+                    // borrowed tree of modified cloud stays valid for its current users
+                    treeEntries.erase(it);
+                }
+                break;
+            }
+            else {
+                ++it;
+            }
+        }
+        if (build) {
+            found = building.get_future().share();
+            if (params->CACHEtrees > 0) {
+                treeEntry entry = {cloud.get(), cloud, key, found};
+                treeEntries.push_front(entry);
+                while (treeEntries.size() > static_cast<size_t>(params->CACHEtrees)) {
+                    treeEntries.pop_back();
+                }
+            }
+        }
+    }
+
+    if (build) {
+        try {
+            pcl::console::TicToc tt;
+            tt.tic();
+            pcl::search::KdTree<PointT>::Ptr tree (new pcl::search::KdTree<PointT> ());
+            // cached tree does not own the cloud, borrowers do
+            tree->setInputCloud (PointCloudT::ConstPtr (cloud.get (), keepCloud ()));
+            PCL_INFO("Kd-tree of %d points built in %g ms\n", key.size, tt.toc());
+            building.set_value(tree);
+        }
+        catch (...) {
+            building.set_exception(std::current_exception());
+            std::lock_guard<std::mutex> lock(treeMutex);
+            for (std::list<treeEntry>::iterator it = treeEntries.begin(); it != treeEntries.end(); ++it) {
+                if (it->address == cloud.get() && it->content == key) {
+                    treeEntries.erase(it);
+                    break;
+                }
+            }
+            throw;
+        }
+    }
+
+    // waits for the tree if another thread builds it
+    boost::shared_ptr<borrowedTree> borrowed (new borrowedTree);
+    borrowed->tree = found.get();
+    borrowed->cloud = cloud;
+    return pcl::search::KdTree<PointT>::Ptr (borrowed, borrowed->tree.get());
+}
+
+/** \brief Drops all cached results
+  */
+void cache::clear() {
+    {
+        std::lock_guard<std::mutex> lock(normalMutex);
+        normalEntries.clear();
+    }
+    std::lock_guard<std::mutex> lock(treeMutex);
+    treeEntries.clear();
+}
@@ -0,0 +1,91 @@
+/*
+    This file is part of RoomScanner.
+
+    RoomScanner is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    RoomScanner is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with RoomScanner.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CACHE_H
+#define CACHE_H
+
+#include "types.h"
+#include "parameters.h"
+#include <pcl/features/normal_3d_omp.h>
+#include <pcl/features/integral_image_normal.h>
+#include <pcl/search/kdtree.h>
+#include <boost/weak_ptr.hpp>
+#include <mutex>
+#include <future>
+#include <list>
+
+// Results shared between processing stages, keyed by content of the cloud
+// so any mutation of the cloud is a miss. Least recently used entries are evicted.
+// Kd-trees are bound to the cloud object they were built on and live only as long as it.
+class cache
+{
+public:
+    typedef pcl::PointCloud<pcl::Normal> NormalCloud;
+
+    // content of cloud at the time of computation
+    struct fingerprint {
+        size_t size;
+        uint64_t hash;
+        bool operator==(const fingerprint &other) const {
+            return size == other.size && hash == other.hash;
+        }
+    };
+
+    static fingerprint compute(const PointCloudT &cloud);
+
+    static NormalCloud::ConstPtr normals(const PointCloudT::ConstPtr &cloud, int k, float radius, const Eigen::Vector3f &viewpoint);
+    static NormalCloud::ConstPtr normals(const PointCloudT::ConstPtr &cloud, int k, float radius);
+    static PointCloudRGBNT::Ptr withNormals(const PointCloudT::ConstPtr &cloud, int k, float radius);
+    static pcl::search::KdTree<PointT>::Ptr kdtree(const PointCloudT::ConstPtr &cloud);
+    static void clear();
+
+private:
+    // neighborhood is k nearest neighbors, or radius if k is zero,
+    // organized clouds use integral images with smoothing size and depth change factor
+    struct normalEntry {
+        fingerprint cloud;
+        bool integral;
+        int k;
+        float radius;
+        float depthChange;
+        Eigen::Vector3f viewpoint;
+        NormalCloud::ConstPtr normals;
+    };
+
+    // tree does not keep its cloud, entry is dropped once the cloud is released,
+    // content is hashed again on every borrow
+    struct treeEntry {
+        const PointCloudT *address;
+        boost::weak_ptr<const PointCloudT> cloud;
+        fingerprint content;
+        std::shared_future<pcl::search::KdTree<PointT>::Ptr> tree;
+    };
+
+    // borrowed tree keeps its cloud alive
+    struct borrowedTree {
+        pcl::search::KdTree<PointT>::Ptr tree;
+        PointCloudT::ConstPtr cloud;
+    };
+
+    static std::mutex normalMutex;
+    static std::list<normalEntry> normalEntries;
+    static std::mutex treeMutex;
+    static std::list<treeEntry> treeEntries;
+    static size_t hits, misses;
+};
+
+#endif // CACHE_H
@@ -0,0 +1,476 @@
+/*
+    This file is part of RoomScanner.
+
+    RoomScanner is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    RoomScanner is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with RoomScanner.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "chunkstore.h"
+#include "pool.h"
+#include "memo.h"
+#include <pcl/common/time.h>
+#include <pcl/io/pcd_io.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <stdexcept>
+
+namespace {
+// exact vertex position, chunks mesh same input points on same lattice so shared
+// vertices of neighboring chunks are bitwise equal
+struct positionKey {
+    uint32_t bits[3];
+    bool operator==(const positionKey &other) const {
+        return bits[0] == other.bits[0] && bits[1] == other.bits[1] && bits[2] == other.bits[2];
+    }
+};
+
+struct positionKeyHash {
+    size_t operator()(const positionKey &k) const {
+        return (static_cast<size_t>(k.bits[0]) * 73856093u) ^ (static_cast<size_t>(k.bits[1]) * 19349663u) ^ (static_cast<size_t>(k.bits[2]) * 83492791u);
+    }
+};
+
+positionKey positionOf(const float *position) {
+    positionKey key;
+    std::memcpy(key.bits, position, sizeof(key.bits));
+    return key;
+}
+}
+
+/** \brief Creates empty store
+  * \param chunkSize edge length of one chunk in meters
+  * \param memoryBudget bytes of resident chunks, the rest is paged to file
+  * \param path of paging file, it is removed with the store
+  */
+chunkstore::chunkstore(float chunkSize, size_t memoryBudget, const std::string &path)
+{
+    this->chunkSize = chunkSize;
+    this->budget = memoryBudget;
+    this->path = path;
+    fileEnd = 0;
+    points = 0;
+    resident = 0;
+    contentKey = 0;
+    file.open(path.c_str(), std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc);
+    paging = file.is_open();
+    if (!paging) {
+        PCL_ERROR("Chunk store can not open %s, chunks stay in memory\n", path.c_str());
+    }
+}
+
+/** \brief Releases chunks and removes paging file
+  */
+chunkstore::~chunkstore() {
+    if (file.is_open()) {
+        file.close();
+        std::remove(path.c_str());
+    }
+}
+
+chunkstore::chunkKey chunkstore::keyOf(const PointT &p) const {
+    chunkKey key = {static_cast<int>(std::floor(p.x / chunkSize)),
+                    static_cast<int>(std::floor(p.y / chunkSize)),
+                    static_cast<int>(std::floor(p.z / chunkSize))};
+    return key;
+}
+
+Eigen::Vector3f chunkstore::corner(const chunkKey &key) const {
+    return chunkSize * Eigen::Vector3f(key.x, key.y, key.z);
+}
+
+// steps are centered in chunk so restored points never round onto next chunk
+Eigen::Vector3f chunkstore::stepOrigin(const chunkKey &key) const {
+    return corner(key).array() + 0.5f * chunkSize / compactCloud::STEPS;
+}
+
+/** \brief Restores full points of resident chunk
+  * \param c resident chunk
+  * \param key of chunk
+  * \param result resultant points
+  */
+void chunkstore::decode(const chunk &c, const chunkKey &key, pointVector &result) const {
+    result.resize(c.points.size());
+    if (!c.points.empty()) {
+        compactCloud::decode(&c.points[0], &result[0], c.points.size(), stepOrigin(key), chunkSize / compactCloud::STEPS);
+    }
+}
+
+/** \brief Makes chunk resident and most recently used, chunk is created if missing
+  * \param key of chunk
+  * \return resident chunk
+  * \throws std::runtime_error when paged chunk can not be read back
+  */
+chunkstore::chunk &chunkstore::touch(const chunkKey &key) {
+    std::unordered_map<chunkKey, chunk, chunkKeyHash>::iterator it = chunks.find(key);
+    if (it == chunks.end()) {
+        chunk &c = chunks[key];
+        c.count = 0;
+        c.loaded = true;
+        c.dirty = false;
+        c.offset = -1;
+        c.capacity = 0;
+        lru.push_front(key);
+        c.lru = lru.begin();
+        return c;
+    }
+    chunk &c = it->second;
+    lru.splice(lru.begin(), lru, c.lru);
+    if (!c.loaded) {
+        const std::streamsize bytes = c.count * sizeof(compactPoint);
+        c.points.resize(c.count);
+        file.seekg(c.offset);
+        file.read(reinterpret_cast<char *>(c.points.data()), bytes);
+        if (!file || file.gcount() != bytes) {
+            file.clear();
+            std::vector<compactPoint>().swap(c.points);
+            PCL_ERROR("Chunk store can not read %d points from %s\n", c.count, path.c_str());
+            throw std::runtime_error("Chunk store can not read paging file " + path);
+        }
+        c.loaded = true;
+        c.dirty = false;
+        resident += c.count * sizeof(compactPoint);
+    }
+    return c;
+}
+
+/** \brief Writes chunk to file if it changed since it was loaded and frees its memory,
+  * when writing fails paging stops and all chunks stay resident
+  * \param c resident chunk
+  */
+void chunkstore::pageOut(chunk &c) {
+    if (c.dirty || c.offset < 0) {
+        if (c.capacity < c.count) {
+            c.offset = fileEnd;
+            c.capacity = c.count;
+            fileEnd += c.count * sizeof(compactPoint);
+        }
+        file.seekp(c.offset);
+        file.write(reinterpret_cast<const char *>(c.points.data()), c.count * sizeof(compactPoint));
+        file.flush();
+        if (!file) {
+            // chunk is still dirty and resident, nothing is lost
+            file.clear();
+            paging = false;
+            c.dirty = true;
+            PCL_ERROR("Chunk store can not write %s, chunks stay in memory\n", path.c_str());
+            return;
+        }
+    }
+    resident -= c.count * sizeof(compactPoint);
+    std::vector<compactPoint>().swap(c.points);
+    c.loaded = false;
+    c.dirty = false;
+}
+
+/** \brief Pages out least recently used chunks until resident chunks fit budget
+  * \param keep chunk which stays resident
+  */
+void chunkstore::evict(const chunkKey &keep) {
+    for (std::list<chunkKey>::reverse_iterator it = lru.rbegin(); paging && it != lru.rend() && resident > budget; ++it) {
+        chunk &c = chunks[*it];
+        if (c.loaded && !(*it == keep)) {
+            pageOut(c);
+        }
+    }
+}
+
+/** \brief Adds points to their chunks
+  * \param cloud points to add, invalid points are skipped
+  */
+void chunkstore::insert(const PointCloudT &cloud) {
+    // bin first so every chunk is touched once
+    std::unordered_map<chunkKey, pointVector, chunkKeyHash> bins;
+    for (size_t i = 0; i < cloud.points.size(); i++) {
+        if (pcl::isFinite(cloud.points[i])) {
+            bins[keyOf(cloud.points[i])].push_back(cloud.points[i]);
+        }
+    }
+    for (std::unordered_map<chunkKey, pointVector, chunkKeyHash>::iterator it = bins.begin(); it != bins.end(); ++it) {
+        chunk &c = touch(it->first);
+        c.points.resize(c.count + it->second.size());
+        compactCloud::encode(&it->second[0], &c.points[c.count], it->second.size(), stepOrigin(it->first), chunkSize / compactCloud::STEPS);
+        contentKey = memo::hash(memo::hash(contentKey, &it->first, sizeof(chunkKey)), &c.points[c.count], it->second.size() * sizeof(compactPoint));
+        c.count += it->second.size();
+        c.dirty = true;
+        points += it->second.size();
+        resident += it->second.size() * sizeof(compactPoint);
+        pointVector().swap(it->second);
+        evict(it->first);
+    }
+}
+
+/** \brief Returns keys of all chunks, neighbors follow each other so their pages are reused
+  */
+std::vector<chunkstore::chunkKey> chunkstore::keys() const {
+    std::vector<chunkKey> result;
+    result.reserve(chunks.size());
+    for (std::unordered_map<chunkKey, chunk, chunkKeyHash>::const_iterator it = chunks.begin(); it != chunks.end(); ++it) {
+        result.push_back(it->first);
+    }
+    std::sort(result.begin(), result.end());
+    return result;
+}
+
+/** \brief Collects points of chunk and of its neighbors within halo
+  * \param key of chunk
+  * \param halo width of overlap, at most one chunk
+  * \param cloud resultant points
+  */
+void chunkstore::gather(const chunkKey &key, float halo, PointCloudT &cloud) {
+    const Eigen::Vector3f coreMin = corner(key);
+    const Eigen::Vector3f haloMin = coreMin.array() - halo;
+    const Eigen::Vector3f haloMax = coreMin.array() + chunkSize + halo;
+    pointVector decoded;
+    cloud.points.clear();
+    for (int dz = -1; dz <= 1; dz++) {
+        for (int dy = -1; dy <= 1; dy++) {
+            for (int dx = -1; dx <= 1; dx++) {
+                const chunkKey neighbor = {key.x + dx, key.y + dy, key.z + dz};
+                if (chunks.find(neighbor) == chunks.end()) {
+                    continue;
+                }
+                decode(touch(neighbor), neighbor, decoded);
+                for (size_t i = 0; i < decoded.size(); i++) {
+                    const PointT &p = decoded[i];
+                    if (p.x >= haloMin[0] && p.y >= haloMin[1] && p.z >= haloMin[2] &&
+                            p.x < haloMax[0] && p.y < haloMax[1] && p.z < haloMax[2]) {
+                        cloud.points.push_back(p);
+                    }
+                }
+                evict(key);
+            }
+        }
+    }
+    cloud.width = cloud.points.size();
+    cloud.height = 1;
+    cloud.is_dense = true;
+}
+
+/** \brief Runs stage on every chunk with its halo, points produced inside the chunk go to output
+  * \param stage filter taking input and output cloud
+  * \param halo width of overlap the stage needs to be seamless, at most one chunk
+  * \param output resultant store
+  */
+void chunkstore::process(const cloudStage &stage, float halo, chunkstore &output) {
+    pcl::console::TicToc tt;
+    tt.tic();
+    const std::vector<chunkKey> order = keys();
+    for (size_t k = 0; k < order.size(); k++) {
+        PointCloudT::Ptr local = pool::cloud();
+        PointCloudT::Ptr result = pool::cloud();
+        progress::check();
+        gather(order[k], halo, *local);
+        {
+            progress::section part(k / static_cast<double>(order.size()), (k + 1) / static_cast<double>(order.size()));
+            stage(local, result);
+        }
+
+        const chunkKey &key = order[k];
+        PointCloudT core;
+        for (size_t i = 0; i < result->points.size(); i++) {
+            if (pcl::isFinite(result->points[i]) && keyOf(result->points[i]) == key) {
+                core.points.push_back(result->points[i]);
+            }
+        }
+        output.insert(core);
+        PCL_INFO("Chunk %d/%d: %d points with halo, %d kept\n", k + 1, order.size(), local->points.size(), core.points.size());
+    }
+    PCL_INFO("Processed %d chunks in %g ms\n", order.size(), tt.toc());
+}
+
+/** \brief Runs mesher on every chunk with its halo, triangles with centroid inside the chunk
+  * are kept and merged to one mesh, vertices at equal positions are welded across chunks.
+  * Meshers placing vertices at input points or on global lattice (greedy projection, marching
+  * cubes) give closed borders, others may leave open seams where chunks meet
+  * \param stage mesher taking input cloud and output mesh
+  * \param halo width of overlap, at most one chunk
+  * \param result resultant mesh, vertices carry position and color
+  */
+void chunkstore::mesh(const meshStage &stage, float halo, const trimesh::Ptr &result) {
+    pcl::console::TicToc tt;
+    tt.tic();
+    result->clear();
+    std::unordered_map<positionKey, uint32_t, positionKeyHash> welded;
+    size_t dropped = 0;
+    const std::vector<chunkKey> order = keys();
+    for (size_t k = 0; k < order.size(); k++) {
+        PointCloudT::Ptr local = pool::cloud();
+        trimesh::Ptr triangles (new trimesh);
+        progress::check();
+        gather(order[k], halo, *local);
+        {
+            progress::section part(k / static_cast<double>(order.size()), (k + 1) / static_cast<double>(order.size()));
+            stage(local, triangles);
+        }
+
+        std::vector<int> remap(triangles->vertexCount(), -1);
+        for (size_t t = 0; t < triangles->triangleCount(); t++) {
+            const uint32_t *indices = &triangles->indices[3 * t];
+            Eigen::Vector3f centroid = Eigen::Vector3f::Zero();
+            for (int v = 0; v < 3; v++) {
+                centroid += Eigen::Vector3f::Map(&triangles->positions[3 * indices[v]]);
+            }
+            PointT center;
+            center.getVector3fMap() = centroid / 3;
+            if (!(keyOf(center) == order[k])) {
+                continue;
+            }
+            uint32_t merged[3];
+            for (int v = 0; v < 3; v++) {
+                if (remap[indices[v]] < 0) {
+                    const positionKey position = positionOf(&triangles->positions[3 * indices[v]]);
+                    std::unordered_map<positionKey, uint32_t, positionKeyHash>::iterator found = welded.find(position);
+                    if (found == welded.end()) {
+                        found = welded.insert(std::make_pair(position, result->addVertex(triangles->vertex(indices[v])))).first;
+                    }
+                    remap[indices[v]] = found->second;
+                }
+                merged[v] = remap[indices[v]];
+            }
+            if (merged[0] == merged[1] || merged[1] == merged[2] || merged[0] == merged[2]) {
+                dropped++;
+                continue;
+            }
+            result->addTriangle(merged[0], merged[1], merged[2]);
+        }
+    }
+    PCL_INFO("Meshed %d chunks to %d triangles and %d vertices in %g ms, %d degenerate dropped\n",
+             order.size(), result->triangleCount(), result->vertexCount(), tt.toc(), dropped);
+}
+
+/** \brief Copies all points to one cloud
+  * \param cloud resultant cloud
+  */
+void chunkstore::extract(PointCloudT &cloud) {
+    cloud.points.clear();
+    cloud.points.reserve(points);
+    const std::vector<chunkKey> order = keys();
+    pointVector decoded;
+    for (size_t k = 0; k < order.size(); k++) {
+        decode(touch(order[k]), order[k], decoded);
+        cloud.points.insert(cloud.points.end(), decoded.begin(), decoded.end());
+        evict(order[k]);
+    }
+    cloud.width = cloud.points.size();
+    cloud.height = 1;
+    cloud.is_dense = true;
+}
+
+/** \brief Runs stage on every chunk alone and replaces its points by result inside the chunk,
+  * meant for stages needing no neighbors like voxel grid aligned with chunks
+  * \param stage filter taking input and output cloud
+  */
+void chunkstore::apply(const cloudStage &stage) {
+    const std::vector<chunkKey> order = keys();
+    pointVector decoded;
+    for (size_t k = 0; k < order.size(); k++) {
+        PointCloudT::Ptr local = pool::cloud();
+        PointCloudT::Ptr result = pool::cloud();
+        progress::check();
+        const chunkKey &key = order[k];
+        chunk &c = touch(key);
+        decode(c, key, decoded);
+        local->points.assign(decoded.begin(), decoded.end());
+        local->width = local->points.size();
+        local->height = 1;
+        local->is_dense = true;
+        stage(local, result);
+
+        decoded.clear();
+        for (size_t i = 0; i < result->points.size(); i++) {
+            if (pcl::isFinite(result->points[i]) && keyOf(result->points[i]) == key) {
+                decoded.push_back(result->points[i]);
+            }
+        }
+        points += decoded.size();
+        points -= c.count;
+        resident += decoded.size() * sizeof(compactPoint);
+        resident -= c.count * sizeof(compactPoint);
+        c.points.resize(decoded.size());
+        if (!decoded.empty()) {
+            compactCloud::encode(&decoded[0], &c.points[0], decoded.size(), stepOrigin(key), chunkSize / compactCloud::STEPS);
+        }
+        c.count = decoded.size();
+        c.dirty = true;
+        contentKey = memo::hash(memo::hash(contentKey, &key, sizeof(chunkKey)), c.points.data(), c.points.size() * sizeof(compactPoint));
+        evict(key);
+    }
+}
+
+/** \brief Copies evenly strided subset of points to one cloud, used to preview store
+  * bigger than memory
+  * \param count most points copied
+  * \param cloud resultant cloud
+  */
+void chunkstore::sample(size_t count, PointCloudT &cloud) {
+    const size_t stride = std::max<size_t>(1, (points + count - 1) / std::max<size_t>(1, count));
+    cloud.points.clear();
+    cloud.points.reserve(points / stride + 1);
+    const std::vector<chunkKey> order = keys();
+    pointVector decoded;
+    // stride continues across chunks
+    size_t skip = 0;
+    for (size_t k = 0; k < order.size(); k++) {
+        decode(touch(order[k]), order[k], decoded);
+        size_t i = skip;
+        for (; i < decoded.size(); i += stride) {
+            cloud.points.push_back(decoded[i]);
+        }
+        skip = i - decoded.size();
+        evict(order[k]);
+    }
+    cloud.width = cloud.points.size();
+    cloud.height = 1;
+    cloud.is_dense = true;
+}
+
+/** \brief Writes all points to binary pcd file chunk by chunk
+  * \param fileName path of pcd file
+  * \return true if the file was written
+  */
+bool chunkstore::save(const std::string &fileName) {
+    std::ofstream out(fileName.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!out.is_open()) {
+        PCL_ERROR("Can not open %s\n", fileName.c_str());
+        return false;
+    }
+    PointCloudT header;
+    header.width = points;
+    header.height = 1;
+    out << pcl::PCDWriter::generateHeader<PointT>(header, points) << "DATA binary\n";
+
+    // fields x y z rgb of each point packed as in pcd writer
+    const std::vector<chunkKey> order = keys();
+    pointVector decoded;
+    std::vector<float> packed;
+    for (size_t k = 0; k < order.size() && out; k++) {
+        decode(touch(order[k]), order[k], decoded);
+        packed.resize(4 * decoded.size());
+        for (size_t i = 0; i < decoded.size(); i++) {
+            packed[4 * i] = decoded[i].x;
+            packed[4 * i + 1] = decoded[i].y;
+            packed[4 * i + 2] = decoded[i].z;
+            packed[4 * i + 3] = decoded[i].rgb;
+        }
+        out.write(reinterpret_cast<const char *>(packed.data()), packed.size() * sizeof(float));
+        evict(order[k]);
+    }
+    if (!out) {
+        PCL_ERROR("Can not write %s\n", fileName.c_str());
+        return false;
+    }
+    PCL_INFO("Saved %d points to %s\n", points, fileName.c_str());
+    return true;
+}
@@ -0,0 +1,118 @@
+/*
+    This file is part of RoomScanner.
+
+    RoomScanner is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    RoomScanner is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with RoomScanner.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CHUNKSTORE_H
+#define CHUNKSTORE_H
+
+#include "types.h"
+#include "parameters.h"
+#include "compact.h"
+#include "progress.h"
+#include "trimesh.h"
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+#include <unordered_map>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <list>
+
+// Points binned into cubic spatial chunks and quantized relative to chunk corner,
+// least recently used chunks are paged
+// to a local file when resident chunks exceed memory budget. Stages stream
+// through chunks with overlap halo and keep only results inside each chunk.
+class chunkstore
+{
+public:
+    typedef boost::shared_ptr<chunkstore> Ptr;
+    typedef boost::function<void (PointCloudT::Ptr, PointCloudT::Ptr)> cloudStage;
+    typedef boost::function<void (PointCloudT::Ptr, trimesh::Ptr)> meshStage;
+
+    struct chunkKey {
+        int x, y, z;
+        bool operator==(const chunkKey &other) const {
+            return x == other.x && y == other.y && z == other.z;
+        }
+        bool operator<(const chunkKey &other) const {
+            if (z != other.z) return z < other.z;
+            if (y != other.y) return y < other.y;
+            return x < other.x;
+        }
+    };
+
+    struct chunkKeyHash {
+        size_t operator()(const chunkKey &k) const {
+            return (static_cast<size_t>(k.x) * 73856093u) ^ (static_cast<size_t>(k.y) * 19349663u) ^ (static_cast<size_t>(k.z) * 83492791u);
+        }
+    };
+
+    chunkstore(float chunkSize, size_t memoryBudget, const std::string &path);
+    ~chunkstore();
+
+    void insert(const PointCloudT &cloud);
+    void process(const cloudStage &stage, float halo, chunkstore &output);
+    void mesh(const meshStage &stage, float halo, const trimesh::Ptr &result);
+    void extract(PointCloudT &cloud);
+    void apply(const cloudStage &stage);
+    void sample(size_t count, PointCloudT &cloud);
+    bool save(const std::string &fileName);
+
+    std::vector<chunkKey> keys() const;
+    size_t size() const { return points; }
+    uint64_t key() const { return contentKey; }
+    size_t residentBytes() const { return resident; }
+    float getChunkSize() const { return chunkSize; }
+
+private:
+    typedef std::vector<PointT, Eigen::aligned_allocator<PointT> > pointVector;
+
+    struct chunk {
+        std::vector<compactPoint> points;
+        size_t count;
+        bool loaded;
+        bool dirty;
+        // slot in file, reused while it is big enough
+        long long offset;
+        size_t capacity;
+        std::list<chunkKey>::iterator lru;
+    };
+
+    chunk &touch(const chunkKey &key);
+    void pageOut(chunk &c);
+    void evict(const chunkKey &keep);
+    void gather(const chunkKey &key, float halo, PointCloudT &cloud);
+    chunkKey keyOf(const PointT &p) const;
+    Eigen::Vector3f corner(const chunkKey &key) const;
+    Eigen::Vector3f stepOrigin(const chunkKey &key) const;
+    void decode(const chunk &c, const chunkKey &key, pointVector &result) const;
+
+    float chunkSize;
+    size_t budget;
+    std::string path;
+    std::fstream file;
+    // false when file could not be opened or written, chunks then stay resident
+    bool paging;
+    long long fileEnd;
+    size_t points;
+    size_t resident;
+    // memo key of content, extended by every change
+    uint64_t contentKey;
+    std::unordered_map<chunkKey, chunk, chunkKeyHash> chunks;
+    std::list<chunkKey> lru;
+};
+
+#endif // CHUNKSTORE_H
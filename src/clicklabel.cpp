@@ -16,22 +16,41 @@
 */
 
 #include "clicklabel.h"
+#include <QPainter>
 
-clickLabel::clickLabel( boost::thread* thr, QWidget * parent )
+clickLabel::clickLabel( progress::Ptr job, QWidget * parent )
 :QLabel(parent)
 {
-    std::cout << "killing thread " << thr->get_id() << "\n";
-    this->thr = thr;
+    this->job = job;
     connect( this, SIGNAL( labelClicked() ), this, SLOT( slotClicked() ) );
+    // repaint progress of job running in another thread
+    timer = new QTimer(this);
+    connect( timer, SIGNAL( timeout() ), this, SLOT( update() ) );
+    timer->start(200);
 }
 
 void clickLabel::slotClicked()
 {
-    // does not work as expected :(
-    this->thr->interrupt();
+    std::cout << "cancelling " << job->getName() << "\n";
+    job->cancel();
 }
 
 void clickLabel::mousePressEvent ( QMouseEvent * event )
 {
     emit labelClicked();
 }
+
+void clickLabel::paintEvent ( QPaintEvent * event )
+{
+    QLabel::paintEvent(event);
+    QPainter painter(this);
+    QString text;
+    if (job->isCancelled()) {
+        text = QString::fromStdString(job->getName()) + "\ncancelling...";
+    }
+    else {
+        text = QString::fromStdString(job->getName()) + " " + QString::number(static_cast<int>(job->getFraction() * 100)) + "%\n"
+                + QString::fromStdString(job->getStage()) + "\nclick to cancel";
+    }
+    painter.drawText(rect(), Qt::AlignHCenter | Qt::AlignBottom, text);
+}
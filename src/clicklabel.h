@@ -21,14 +21,17 @@
 #include <QLabel>
 #include <QMainWindow>
 #include <QThread>
+#include <QTimer>
 #include <boost/thread/thread.hpp>
+#include "progress.h"
 
+// Loading animation of background job showing its progress, click cancels the job
 class clickLabel : public QLabel
 {
     Q_OBJECT
 public:
-    boost::thread* thr;
-    clickLabel( boost::thread* thr, QWidget * parent = 0 );
+    progress::Ptr job;
+    clickLabel( progress::Ptr job, QWidget * parent = 0 );
     ~clickLabel(){}
 
 signals:
@@ -39,6 +42,10 @@ public slots:
 
 protected:
     void mousePressEvent ( QMouseEvent * event ) ;
+    void paintEvent ( QPaintEvent * event ) ;
+
+private:
+    QTimer* timer;
 
 };
 
@@ -0,0 +1,154 @@
+/*
+    This file is part of RoomScanner.
+
+    RoomScanner is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    RoomScanner is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with RoomScanner.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "compact.h"
+#include <limits>
+#include <cmath>
+#include <algorithm>
+
+compactCloud::compactCloud()
+{
+    origin.setZero();
+    resolution = 0.001f;
+    width = height = 0;
+    sensorOrigin.setZero();
+    sensorOrientation.setIdentity();
+}
+
+/** \brief Creates quantized copy of cloud
+  * \param cloud input cloud
+  * \param resolution requested step of coordinates, coarser if cloud does not fit 16 bits
+  */
+compactCloud::compactCloud(const PointCloudT &cloud, float resolution)
+{
+    assign(cloud, resolution);
+}
+
+/** \brief Replaces content by quantized copy of cloud
+  * \param cloud input cloud
+  * \param resolution requested step of coordinates, coarser if cloud does not fit 16 bits
+  */
+void compactCloud::assign(const PointCloudT &cloud, float resolution) {
+    const int size = cloud.points.size();
+    float minX = std::numeric_limits<float>::max(), minY = minX, minZ = minX;
+    float maxX = -std::numeric_limits<float>::max(), maxY = maxX, maxZ = maxX;
+#pragma omp parallel for reduction(min:minX,minY,minZ) reduction(max:maxX,maxY,maxZ)
+    for (int i = 0; i < size; i++) {
+        const PointT &p = cloud.points[i];
+        if (pcl::isFinite(p)) {
+            minX = std::min(minX, p.x);
+            minY = std::min(minY, p.y);
+            minZ = std::min(minZ, p.z);
+            maxX = std::max(maxX, p.x);
+            maxY = std::max(maxY, p.y);
+            maxZ = std::max(maxZ, p.z);
+        }
+    }
+    if (minX > maxX) {
+        minX = minY = minZ = maxX = maxY = maxZ = 0.0f;
+    }
+    const float extent = std::max(maxX - minX, std::max(maxY - minY, maxZ - minZ));
+    if (extent > resolution * STEPS) {
+        PCL_INFO("Cloud of extent %g does not fit 16 bits with resolution %g\n", extent, resolution);
+        resolution = extent / STEPS;
+    }
+
+    this->origin = Eigen::Vector3f(minX, minY, minZ);
+    this->resolution = resolution;
+    width = cloud.width;
+    height = cloud.height;
+    sensorOrigin = cloud.sensor_origin_;
+    sensorOrientation = cloud.sensor_orientation_;
+    points.resize(size);
+    if (size > 0) {
+        encode(&cloud.points[0], &points[0], size, origin, resolution);
+    }
+}
+
+/** \brief Restores full cloud
+  * \param cloud resultant cloud
+  */
+void compactCloud::toCloud(PointCloudT &cloud) const {
+    const int size = points.size();
+    cloud.points.resize(size);
+    cloud.width = width;
+    cloud.height = height;
+    cloud.sensor_origin_ = sensorOrigin;
+    cloud.sensor_orientation_ = sensorOrientation;
+    if (size > 0) {
+        decode(&points[0], &cloud.points[0], size, origin, resolution);
+    }
+    bool dense = true;
+    for (int i = 0; i < size && dense; i++) {
+        dense = points[i].x != INVALID;
+    }
+    cloud.is_dense = dense;
+}
+
+/** \brief Quantizes points, steps are rounded and clamped to 16 bits
+  * \param points input points
+  * \param result resultant compact points
+  * \param count number of points
+  * \param origin coordinates of step zero minus half of range
+  * \param resolution size of one step
+  */
+void compactCloud::encode(const PointT *points, compactPoint *result, int count, const Eigen::Vector3f &origin, float resolution) {
+    const float inverse = 1.0f / resolution;
+    const float offset = 0.5f - STEPS / 2;
+    const float ox = origin[0], oy = origin[1], oz = origin[2];
+#pragma omp parallel for simd
+    for (int i = 0; i < count; i++) {
+        const PointT &p = points[i];
+        const bool valid = std::isfinite(p.x) && std::isfinite(p.y) && std::isfinite(p.z);
+        const float x = valid ? std::floor((p.x - ox) * inverse + offset) : 0.0f;
+        const float y = valid ? std::floor((p.y - oy) * inverse + offset) : 0.0f;
+        const float z = valid ? std::floor((p.z - oz) * inverse + offset) : 0.0f;
+        compactPoint &c = result[i];
+        c.x = valid ? static_cast<int16_t>(std::min(32767.0f, std::max(-32767.0f, x))) : INVALID;
+        c.y = static_cast<int16_t>(std::min(32767.0f, std::max(-32767.0f, y)));
+        c.z = static_cast<int16_t>(std::min(32767.0f, std::max(-32767.0f, z)));
+        c.r = p.r;
+        c.g = p.g;
+        c.b = p.b;
+        c.a = p.a;
+    }
+}
+
+/** \brief Restores points from their steps
+  * \param points input compact points
+  * \param result resultant points
+  * \param count number of points
+  * \param origin coordinates of step zero minus half of range
+  * \param resolution size of one step
+  */
+void compactCloud::decode(const compactPoint *points, PointT *result, int count, const Eigen::Vector3f &origin, float resolution) {
+    const float nan = std::numeric_limits<float>::quiet_NaN();
+    const float ox = origin[0] + resolution * (STEPS / 2), oy = origin[1] + resolution * (STEPS / 2), oz = origin[2] + resolution * (STEPS / 2);
+#pragma omp parallel for simd
+    for (int i = 0; i < count; i++) {
+        const compactPoint &c = points[i];
+        const bool valid = c.x != INVALID;
+        PointT &p = result[i];
+        p.x = valid ? ox + c.x * resolution : nan;
+        p.y = valid ? oy + c.y * resolution : nan;
+        p.z = valid ? oz + c.z * resolution : nan;
+        p.r = c.r;
+        p.g = c.g;
+        p.b = c.b;
+        p.a = c.a;
+    }
+}
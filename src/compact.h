@@ -0,0 +1,64 @@
+/*
+    This file is part of RoomScanner.
+
+    RoomScanner is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    RoomScanner is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with RoomScanner.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef COMPACT_H
+#define COMPACT_H
+
+#include "types.h"
+#include <boost/shared_ptr.hpp>
+#include <vector>
+#include <cstdint>
+
+// 10 byte point for clouds at rest, coordinates are 16 bit steps from origin of the cloud
+struct compactPoint {
+    int16_t x, y, z;
+    uint8_t r, g, b, a;
+};
+
+// Quantized copy of a cloud which keeps its organization, NaN points stay NaN.
+class compactCloud
+{
+public:
+    typedef boost::shared_ptr<compactCloud> Ptr;
+
+    // x of invalid point, valid steps are symmetric around zero
+    static const int16_t INVALID = -32768;
+    static const int STEPS = 65534;
+
+    compactCloud();
+    compactCloud(const PointCloudT &cloud, float resolution);
+
+    void assign(const PointCloudT &cloud, float resolution);
+    void toCloud(PointCloudT &cloud) const;
+
+    static void encode(const PointT *points, compactPoint *result, int count, const Eigen::Vector3f &origin, float resolution);
+    static void decode(const compactPoint *points, PointT *result, int count, const Eigen::Vector3f &origin, float resolution);
+
+    size_t size() const { return points.size(); }
+    size_t bytes() const { return points.size() * sizeof(compactPoint); }
+    float getResolution() const { return resolution; }
+
+private:
+    std::vector<compactPoint> points;
+    Eigen::Vector3f origin;
+    float resolution;
+    uint32_t width, height;
+    Eigen::Vector4f sensorOrigin;
+    Eigen::Quaternionf sensorOrientation;
+};
+
+#endif // COMPACT_H
@@ -16,32 +16,384 @@
 */
 
 #include "filters.h"
+#include "pool.h"
+#include <pcl/common/time.h>
+#include <limits>
+#include <cmath>
+#include <unordered_map>
+#include <algorithm>
+#include <thread>
+#include <sstream>
+#include <boost/algorithm/string/trim.hpp>
+#include <pcl/io/pcd_io.h>
+#include <pcl/filters/filter.h>
+
+namespace {
+
+// Bilateral grid of pcl::FastBilateralFilter, cells hold (sum of depths, count) pairs
+// and depth index runs fastest like in pcl.
+class bilateralGrid {
+public:
+    bilateralGrid(int imageWidth, int imageHeight, float baseMin, float baseMax, float sigmaS, float sigmaR)
+        : baseMin(baseMin), baseMax(baseMax), sigmaS(sigmaS), sigmaR(sigmaR) {
+        width = static_cast<size_t>(static_cast<float>(imageWidth - 1) / sigmaS) + 1 + 2 * padXY;
+        height = static_cast<size_t>(static_cast<float>(imageHeight - 1) / sigmaS) + 1 + 2 * padXY;
+        depth = static_cast<size_t>((baseMax - baseMin) / sigmaR) + 1 + 2 * padZ;
+        values.assign(2 * width * height * depth, 0.0f);
+    }
+
+    // accumulates organized cloud, unknown depths are replaced by maximal depth like in pcl
+    void splat(PointCloudT &cloud) {
+        const int imageWidth = cloud.width;
+        const int imageHeight = cloud.height;
+        std::vector<size_t> smallX(imageWidth);
+        for (int x = 0; x < imageWidth; x++) {
+            smallX[x] = static_cast<size_t>(static_cast<float>(x) / sigmaS + 0.5f) + padXY;
+        }
+        // rows are monotonic so every grid row owns a band of image rows
+        std::vector<int> bandStart(height + 1, imageHeight);
+        size_t band = 0;
+        for (int y = 0; y < imageHeight; y++) {
+            const size_t smallY = static_cast<size_t>(static_cast<float>(y) / sigmaS + 0.5f) + padXY;
+            while (band <= smallY) {
+                bandStart[band++] = y;
+            }
+        }
+
+        // bands keep column-major order of pcl so sums are bit exact
+#pragma omp parallel for schedule(dynamic)
+        for (int smallY = 0; smallY < static_cast<int>(height); smallY++) {
+            for (int x = 0; x < imageWidth; x++) {
+                for (int y = bandStart[smallY]; y < bandStart[smallY + 1]; y++) {
+                    float &depthValue = cloud(x, y).z;
+                    if (!std::isfinite(depthValue)) {
+                        depthValue = baseMax;
+                    }
+                    const float z = depthValue - baseMin;
+                    const size_t smallZ = static_cast<size_t>(static_cast<float>(z) / sigmaR + 0.5f) + padZ;
+                    float *d = at(smallX[x], smallY, smallZ);
+                    d[0] += depthValue;
+                    d[1] += 1.0f;
+                }
+            }
+        }
+    }
+
+    // [1 2 1] blur in each dimension, depth is contiguous so inner loop vectorizes
+    void blur() {
+        std::vector<float> buffer(values.size(), 0.0f);
+        const long offset[3] = {at(1, 0, 0) - at(0, 0, 0), at(0, 1, 0) - at(0, 0, 0), at(0, 0, 1) - at(0, 0, 0)};
+        const long run = 2 * static_cast<long>(depth - 2);
+        for (int dim = 0; dim < 3; dim++) {
+            const long off = offset[dim];
+            for (int iter = 0; iter < 2; iter++) {
+                values.swap(buffer);
+#pragma omp parallel for
+                for (int y = 1; y < static_cast<int>(height) - 1; y++) {
+                    for (size_t x = 1; x < width - 1; x++) {
+                        float *d = at(x, y, 1);
+                        const float *b = &buffer[d - &values[0]];
+#pragma omp simd
+                        for (long k = 0; k < run; k++) {
+                            d[k] = (b[k - off] + b[k + off] + 2.0f * b[k]) / 4.0f;
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    // writes filtered depths of one image row
+    void sliceRow(PointCloudT &cloud, int y) const {
+        for (int x = 0; x < static_cast<int>(cloud.width); x++) {
+            PointT &p = cloud(x, y);
+            const float z = p.z - baseMin;
+            float value[2];
+            trilinear(static_cast<float>(x) / sigmaS + padXY, static_cast<float>(y) / sigmaS + padXY, z / sigmaR + padZ, value);
+            p.z = value[0] / value[1];
+        }
+    }
+
+private:
+    static const size_t padXY = 2;
+    static const size_t padZ = 2;
+
+    float *at(size_t x, size_t y, size_t z) {
+        return &values[2 * ((x + y * width) * depth + z)];
+    }
+
+    const float *at(size_t x, size_t y, size_t z) const {
+        return &values[2 * ((x + y * width) * depth + z)];
+    }
+
+    static size_t clamp(size_t i, size_t max) {
+        return (i > max) ? max : i;
+    }
+
+    void trilinear(float x, float y, float z, float *result) const {
+        const size_t xi = clamp(static_cast<size_t>(x), width - 1), xxi = clamp(xi + 1, width - 1);
+        const size_t yi = clamp(static_cast<size_t>(y), height - 1), yyi = clamp(yi + 1, height - 1);
+        const size_t zi = clamp(static_cast<size_t>(z), depth - 1), zzi = clamp(zi + 1, depth - 1);
+        const float xa = x - static_cast<float>(xi);
+        const float ya = y - static_cast<float>(yi);
+        const float za = z - static_cast<float>(zi);
+        const float w[8] = {(1.0f - xa) * (1.0f - ya) * (1.0f - za), xa * (1.0f - ya) * (1.0f - za),
+                            (1.0f - xa) * ya * (1.0f - za), xa * ya * (1.0f - za),
+                            (1.0f - xa) * (1.0f - ya) * za, xa * (1.0f - ya) * za,
+                            (1.0f - xa) * ya * za, xa * ya * za};
+        const float *v[8] = {at(xi, yi, zi), at(xxi, yi, zi), at(xi, yyi, zi), at(xxi, yyi, zi),
+                             at(xi, yi, zzi), at(xxi, yi, zzi), at(xi, yyi, zzi), at(xxi, yyi, zzi)};
+        for (int c = 0; c < 2; c++) {
+            result[c] = w[0] * v[0][c];
+            for (int i = 1; i < 8; i++) {
+                result[c] = result[c] + w[i] * v[i][c];
+            }
+        }
+    }
+
+    size_t width, height, depth;
+    std::vector<float> values;
+    float baseMin, baseMax, sigmaS, sigmaR;
+};
+
+// depth range of finite points, false if there is none
+bool depthRange(const PointCloudT &cloud, float &baseMin, float &baseMax) {
+    float low = std::numeric_limits<float>::max();
+    float high = -std::numeric_limits<float>::max();
+#pragma omp parallel for reduction(max:high) reduction(min:low)
+    for (int i = 0; i < static_cast<int>(cloud.points.size()); i++) {
+        const float z = cloud.points[i].z;
+        if (std::isfinite(z)) {
+            high = std::max(high, z);
+            low = std::min(low, z);
+        }
+    }
+    baseMin = low;
+    baseMax = high;
+    return low <= high;
+}
+
+struct cellKey {
+    int x, y, z;
+    bool operator==(const cellKey &other) const {
+        return x == other.x && y == other.y && z == other.z;
+    }
+};
+
+struct cellKeyHash {
+    size_t operator()(const cellKey &k) const {
+        return (static_cast<size_t>(k.x) * 73856093u) ^ (static_cast<size_t>(k.y) * 19349663u) ^ (static_cast<size_t>(k.z) * 83492791u);
+    }
+};
+
+// voxel of finite point on global lattice
+template <typename Point>
+inline cellKey voxelOf(const Point &p, float inverseLeaf) {
+    const cellKey key = {static_cast<int>(std::floor(p.x * inverseLeaf)),
+                         static_cast<int>(std::floor(p.y * inverseLeaf)),
+                         static_cast<int>(std::floor(p.z * inverseLeaf))};
+    return key;
+}
+
+inline bool withinRadius(const PointT &a, const PointT &b, float sqrRadius) {
+    const float dx = a.x - b.x, dy = a.y - b.y, dz = a.z - b.z;
+    return dx * dx + dy * dy + dz * dz <= sqrRadius;
+}
+
+// true if point of organized cloud has enough neighbors within radius in image window
+bool organizedInlier(const PointCloudT &cloud, int x, int y, int window, float sqrRadius, int minNeighbors) {
+    const PointT &p = cloud(x, y);
+    const int width = cloud.width;
+    const int height = cloud.height;
+    int count = 0;
+    for (int v = std::max(0, y - window); v <= std::min(height - 1, y + window) && count < minNeighbors; v++) {
+        for (int u = std::max(0, x - window); u <= std::min(width - 1, x + window) && count < minNeighbors; u++) {
+            const PointT &q = cloud(u, v);
+            if ((u != x || v != y) && pcl::isFinite(q) && withinRadius(p, q, sqrRadius)) {
+                count++;
+            }
+        }
+    }
+    return count >= minNeighbors;
+}
+
+// point of voxel grid copied in shard order, half the size of PointT
+struct voxelPoint {
+    float x, y, z;
+    uint8_t r, g, b;
+};
+
+// sums of points falling into one voxel
+struct voxelSum {
+    float x, y, z;
+    unsigned int r, g, b;
+    int count;
+};
+
+// shards of voxel hash map filled independently, blocks of points scattered independently
+const int VOXEL_SHARDS = 256;
+const int VOXEL_BLOCKS = 64;
+
+// rough memory of one tile point in MLS: copy, kd-tree, fitted surface and upsampled output
+const double MLS_BYTES_PER_POINT = 256.0;
+
+// cell of MLS tiling with range of its points in sorted order
+struct mlsTile {
+    int x, y, z;
+    int begin, end;
+    bool operator<(const mlsTile &other) const {
+        if (x != other.x) return x < other.x;
+        if (y != other.y) return y < other.y;
+        return z < other.z;
+    }
+};
+
+inline bool inBox(const PointT &p, const Eigen::Vector3f &min, const Eigen::Vector3f &max) {
+    return p.x >= min[0] && p.y >= min[1] && p.z >= min[2] && p.x < max[0] && p.y < max[1] && p.z < max[2];
+}
+
+}
 
 filters::filters()
 {
 
 }
 
-/** \brief Voxel grid filter
+/** \brief Voxel grid filter on parallel hash map, points of voxel are replaced by their centroid
+  * with averaged color, voxel keys are not linearized so there is no limit on cloud extent
   * \param cloudToFilter pointer to input cloud
-  * \param filtered pointer to resultant cloud
-  * \param leaf size of cubic voxel
+  * \param filtered pointer to resultant cloud, may be the input cloud, its memory is reused
+  * \param leaf size of voxel, parameter value is used if not positive
   */
 void filters::voxelGridFilter(PointCloudT::Ptr cloudToFilter, PointCloudT::Ptr filtered, float leaf) {
     PCL_INFO("downsampling filter\n");
 
     parameters* params = parameters::GetInstance();
-    pcl::VoxelGrid<PointT> ds;  //create downsampling filter
-    ds.setInputCloud (cloudToFilter);
     if (leaf > 0.00000f) {
         PCL_INFO("VoxelGrid parameter with priority %f\n", leaf);
-        ds.setLeafSize (leaf, leaf, leaf);
     }
     else {
-        ds.setLeafSize (params->VGFleafSize, params->VGFleafSize, params->VGFleafSize);
+        leaf = params->VGFleafSize;
+    }
+    pcl::console::TicToc tt;
+    tt.tic();
+    const PointCloudT &cloud = *cloudToFilter;
+    const int size = cloud.points.size();
+    const int blockSize = (size + VOXEL_BLOCKS - 1) / VOXEL_BLOCKS;
+
+    const float inverseLeaf = 1.0f / leaf;
+
+    // pass 1: shard of every point from its voxel, shard sizes per block
+    std::vector<short> shards(size);
+    std::vector<int> counts(VOXEL_BLOCKS * VOXEL_SHARDS, 0);
+#pragma omp parallel for schedule(dynamic, 1)
+    for (int block = 0; block < VOXEL_BLOCKS; block++) {
+        int *blockCounts = &counts[block * VOXEL_SHARDS];
+        for (int i = block * blockSize; i < std::min(size, (block + 1) * blockSize); i++) {
+            if (!pcl::isFinite(cloud.points[i])) {
+                shards[i] = -1;
+                continue;
+            }
+            shards[i] = cellKeyHash()(voxelOf(cloud.points[i], inverseLeaf)) % VOXEL_SHARDS;
+            blockCounts[shards[i]]++;
+        }
+    }
+
+    // pass 2: points copied in shard order, keeping their order inside shard,
+    // pass 3 then reads memory sequentially instead of jumping through the cloud
+    std::vector<int> offsets(VOXEL_BLOCKS * VOXEL_SHARDS + 1, 0);
+    std::vector<int> shardStart(VOXEL_SHARDS + 1, 0);
+    int position = 0;
+    for (int shard = 0; shard < VOXEL_SHARDS; shard++) {
+        shardStart[shard] = position;
+        for (int block = 0; block < VOXEL_BLOCKS; block++) {
+            offsets[block * VOXEL_SHARDS + shard] = position;
+            position += counts[block * VOXEL_SHARDS + shard];
+        }
+    }
+    shardStart[VOXEL_SHARDS] = position;
+    std::vector<voxelPoint> order(position);
+#pragma omp parallel for schedule(dynamic, 1)
+    for (int block = 0; block < VOXEL_BLOCKS; block++) {
+        int *blockOffsets = &offsets[block * VOXEL_SHARDS];
+        for (int i = block * blockSize; i < std::min(size, (block + 1) * blockSize); i++) {
+            if (shards[i] >= 0) {
+                const PointT &p = cloud.points[i];
+                const voxelPoint point = {p.x, p.y, p.z, p.r, p.g, p.b};
+                order[blockOffsets[shards[i]]++] = point;
+            }
+        }
+    }
+    std::vector<short>().swap(shards);
+
+    // pass 3: every shard owns its voxels, no locking is needed, keys are recomputed instead of stored,
+    // voxels of shard are found in open addressing table at most half full
+    std::vector<std::vector<voxelSum> > sums(VOXEL_SHARDS);
+#pragma omp parallel for schedule(dynamic, 1)
+    for (int shard = 0; shard < VOXEL_SHARDS; shard++) {
+        size_t capacity = 16;
+        while (capacity < 2 * static_cast<size_t>(shardStart[shard + 1] - shardStart[shard])) {
+            capacity *= 2;
+        }
+        std::vector<int> table(capacity, -1);
+        std::vector<cellKey> keys;
+        std::vector<voxelSum> &shardSums = sums[shard];
+        for (int j = shardStart[shard]; j < shardStart[shard + 1]; j++) {
+            const voxelPoint &p = order[j];
+            const cellKey key = voxelOf(p, inverseLeaf);
+            // low bits of hash select the shard, table uses the rest
+            size_t slot = (cellKeyHash()(key) / VOXEL_SHARDS) & (capacity - 1);
+            while (table[slot] >= 0 && !(keys[table[slot]] == key)) {
+                slot = (slot + 1) & (capacity - 1);
+            }
+            if (table[slot] < 0) {
+                table[slot] = shardSums.size();
+                keys.push_back(key);
+                voxelSum sum = {0.0f, 0.0f, 0.0f, 0, 0, 0, 0};
+                shardSums.push_back(sum);
+            }
+            voxelSum &sum = shardSums[table[slot]];
+            sum.x += p.x;
+            sum.y += p.y;
+            sum.z += p.z;
+            sum.r += p.r;
+            sum.g += p.g;
+            sum.b += p.b;
+            sum.count++;
+        }
+    }
+    std::vector<voxelPoint>().swap(order);
+
+    // pass 4: centroids written straight to output
+    std::vector<int> outputStart(VOXEL_SHARDS + 1, 0);
+    for (int shard = 0; shard < VOXEL_SHARDS; shard++) {
+        outputStart[shard + 1] = outputStart[shard] + sums[shard].size();
+    }
+    if (filtered != cloudToFilter) {
+        filtered->header = cloud.header;
+        filtered->sensor_origin_ = cloud.sensor_origin_;
+        filtered->sensor_orientation_ = cloud.sensor_orientation_;
+    }
+    filtered->points.resize(outputStart[VOXEL_SHARDS]);
+#pragma omp parallel for schedule(dynamic, 1)
+    for (int shard = 0; shard < VOXEL_SHARDS; shard++) {
+        for (size_t v = 0; v < sums[shard].size(); v++) {
+            const voxelSum &sum = sums[shard][v];
+            const float inverseCount = 1.0f / sum.count;
+            PointT &p = filtered->points[outputStart[shard] + v];
+            p = PointT();
+            p.x = sum.x * inverseCount;
+            p.y = sum.y * inverseCount;
+            p.z = sum.z * inverseCount;
+            p.r = (sum.r + sum.count / 2) / sum.count;
+            p.g = (sum.g + sum.count / 2) / sum.count;
+            p.b = (sum.b + sum.count / 2) / sum.count;
+        }
     }
-    ds.filter (*filtered);
-    PCL_INFO("Filtered points: %d\n", filtered->points.size());
+    filtered->width = filtered->points.size();
+    filtered->height = 1;
+    filtered->is_dense = true;
+    PCL_INFO("Filtered points: %d in %g ms\n", filtered->points.size(), tt.toc());
 }
 
 /** \brief Downsampling performed by uniform sampling filter
@@ -58,41 +410,205 @@ void filters::downsample (const PointCloudT::Ptr &input,  PointCloudT &output, d
     uniform.filter (output);
 }
 
-/** \brief Smoothing of input cloud performed by MLS
+/** \brief Moving least squares smoothing with voxel grid dilation upsampling,
+  * space is cut into tiles smoothed in parallel, each tile sees its neighbors through overlap
+  * and keeps only points generated inside its own core, dilation lattices of all tiles are aligned;
+  * finished tiles are appended to the result in tile order, so besides input and result
+  * only tiles in flight take memory and MLSmemoryLimit bounds them
   * \param cloudToSmooth pointer to input cloud
-  * \param output pointer to resultant cloud
+  * \param output pointer to resultant cloud, may be the input cloud
   */
 void filters::cloudSmoothMLS(PointCloudT::Ptr cloudToSmooth, PointCloudT::Ptr output) {
     PCL_INFO("smoothing %d points\n", cloudToSmooth->points.size());
 
     parameters* params = parameters::GetInstance();
+    pcl::console::TicToc tt;
+    tt.tic();
+    const PointCloudT &cloud = *cloudToSmooth;
+
+    std::vector<int> valid;
+    valid.reserve(cloud.points.size());
+    Eigen::Vector3f minPt = Eigen::Vector3f::Constant(std::numeric_limits<float>::max());
+    for (size_t i = 0; i < cloud.points.size(); i++) {
+        if (pcl::isFinite(cloud.points[i])) {
+            valid.push_back(i);
+            minPt = minPt.cwiseMin(cloud.points[i].getVector3fMap());
+        }
+    }
+    if (valid.empty()) {
+        PCL_INFO("Nothing to smooth\n");
+        return;
+    }
+
+    // dilated voxels reach margin beyond their seed points, surface fit needs search radius more
+    const float margin = params->MLSdilationIterations * params->MLSdilationVoxelSize;
+    const float halo = margin + params->MLSsearchRadius;
+    const double limit = params->MLSmemoryLimit * 1024.0 * 1024.0;
+
+    // halve tiles until the biggest one fits into memory limit
+    float side = std::max<float>(params->MLStileSize, 2.0f * halo);
+    std::vector<std::pair<mlsTile, int> > cells(valid.size());
+    std::vector<mlsTile> tiles;
+    std::vector<int> order(valid.size());
+    double biggest;
+    for (;;) {
+#pragma omp parallel for
+        for (int i = 0; i < static_cast<int>(valid.size()); i++) {
+            const Eigen::Vector3f cell = (cloud.points[valid[i]].getVector3fMap() - minPt) / side;
+            mlsTile key = {static_cast<int>(cell[0]), static_cast<int>(cell[1]), static_cast<int>(cell[2]), 0, 0};
+            cells[i] = std::make_pair(key, valid[i]);
+        }
+        std::sort(cells.begin(), cells.end());
+
+        tiles.clear();
+        biggest = 0;
+        const double inflation = std::pow((side + 2.0 * halo) / side, 3.0);
+        for (int i = 0; i < static_cast<int>(cells.size()); i++) {
+            order[i] = cells[i].second;
+            if (tiles.empty() || tiles.back() < cells[i].first) {
+                tiles.push_back(cells[i].first);
+                tiles.back().begin = i;
+            }
+            tiles.back().end = i + 1;
+            biggest = std::max(biggest, (tiles.back().end - tiles.back().begin) * inflation * MLS_BYTES_PER_POINT);
+        }
+        if (biggest <= limit || side <= 2.0f * halo) {
+            break;
+        }
+        side = std::max(side / 2.0f, 2.0f * halo);
+    }
+    cells.clear();
+    cells.shrink_to_fit();
+
+    // run only as many tiles at once as the memory limit allows
+    const int concurrent = std::max(1, std::min(static_cast<int>(limit / std::max(biggest, 1.0)),
+                                                static_cast<int>(std::thread::hardware_concurrency())));
+    PCL_INFO("MLS runs %d tiles of size %g, %d at once\n", tiles.size(), side, concurrent);
+
+    // output may be the input which tiles still read, result replaces it at the end
+    PointCloudT::Ptr result (new PointCloudT);
+    // worker threads have no job of their own, cancelled job skips remaining tiles
+    const progress::Ptr job = progress::current();
+    const pool::jobPtr poolJob = pool::current();
+    int done = 0;
+#pragma omp parallel for ordered schedule(dynamic, 1) num_threads(concurrent)
+    for (int t = 0; t < static_cast<int>(tiles.size()); t++) {
+        if (job && job->isCancelled()) {
+            continue;
+        }
+        pool::worker worker(poolJob);
+        const mlsTile &tile = tiles[t];
+        const Eigen::Vector3f coreMin = minPt + side * Eigen::Vector3f(tile.x, tile.y, tile.z);
+        const Eigen::Vector3f coreMax = coreMin + Eigen::Vector3f::Constant(side);
+        const Eigen::Vector3f seedMin = coreMin.array() - margin, seedMax = coreMax.array() + margin;
+        const Eigen::Vector3f haloMin = coreMin.array() - halo, haloMax = coreMax.array() + halo;
+
+        // gather points of tile with overlap, halo is at most one tile wide
+        PointCloudT::Ptr local = pool::cloud();
+        boost::shared_ptr<std::vector<int> > seeds (new std::vector<int> ());
+        for (int dx = -1; dx <= 1; dx++) {
+            for (int dy = -1; dy <= 1; dy++) {
+                for (int dz = -1; dz <= 1; dz++) {
+                    const mlsTile key = {tile.x + dx, tile.y + dy, tile.z + dz, 0, 0};
+                    std::vector<mlsTile>::const_iterator neighbor = std::lower_bound(tiles.begin(), tiles.end(), key);
+                    if (neighbor == tiles.end() || key < *neighbor) {
+                        continue;
+                    }
+                    for (int i = neighbor->begin; i < neighbor->end; i++) {
+                        const PointT &p = cloud.points[order[i]];
+                        if (inBox(p, haloMin, haloMax)) {
+                            if (inBox(p, seedMin, seedMax)) {
+                                seeds->push_back(local->points.size());
+                            }
+                            local->points.push_back(p);
+                        }
+                    }
+                }
+            }
+        }
+        if (!seeds->empty()) {
+            // dilation lattice of pcl starts at the lowest seed, a sentinel seed below the whole tile
+            // snaps it to the grid shared by all tiles, so samples line up at tile borders;
+            // sentinel is too far to have neighbors, its fit and voxels are dropped by mls
+            const float voxel = params->MLSdilationVoxelSize;
+            const float away = std::max(2.0f * std::sqrt(3.0f) * (params->MLSdilationIterations + 1) * voxel,
+                                        static_cast<float>(params->MLSsearchRadius)) + voxel;
+            const Eigen::Vector3f steps = ((haloMin - minPt) / voxel).array().floor() - std::ceil(away / voxel);
+            PointT sentinel = local->points[seeds->front()];
+            sentinel.getVector3fMap() = minPt + voxel * steps;
+            seeds->push_back(local->points.size());
+            local->points.push_back(sentinel);
+        }
+        local->width = local->points.size();
+        local->height = 1;
+
+        pcl::search::KdTree<PointT>::Ptr tree (new pcl::search::KdTree<PointT> ());
+        pcl::MovingLeastSquares<PointT, PointT> mls;
+        mls.setInputCloud (local);
+        mls.setIndices (seeds);
+        mls.setSearchMethod (tree);
+        mls.setComputeNormals (params->MLScomputeNormals);
+        mls.setSearchRadius (params->MLSsearchRadius);
+        mls.setSqrGaussParam (params->MLSsqrGaussParam);
+        mls.setPolynomialFit (params->MLSusePolynomialFit);
+        mls.setPolynomialOrder (params->MLSpolynomialOrder);
+        mls.setUpsamplingRadius (params->MLSupsamplingRadius);
+        mls.setUpsamplingStepSize (params->MLSupsamplingStepSize);
+        mls.setDilationVoxelSize (params->MLSdilationVoxelSize);
+        mls.setDilationIterations (params->MLSdilationIterations);
+        mls.setUpsamplingMethod (pcl::MovingLeastSquares<PointT, PointT>::VOXEL_GRID_DILATION);
+
+        PointCloudT smoothed;
+        mls.process (smoothed);
+        // finished tile waits for the previous ones, at most one tile per thread is held
+#pragma omp ordered
+        for (size_t i = 0; i < smoothed.points.size(); i++) {
+            if (inBox(smoothed.points[i], coreMin, coreMax)) {
+                result->points.push_back(smoothed.points[i]);
+            }
+        }
+        int finished;
+#pragma omp atomic capture
+        finished = ++done;
+        if (job) {
+            job->report(static_cast<double>(finished) / tiles.size(), "MLS");
+        }
+    }
+    progress::check();
+
+    if (output != cloudToSmooth) {
+        output->header = cloud.header;
+        output->sensor_origin_ = cloud.sensor_origin_;
+        output->sensor_orientation_ = cloud.sensor_orientation_;
+    }
+    // previous points of output are freed with result
+    output->points.swap(result->points);
+    output->width = output->points.size();
+    output->height = 1;
+    output->is_dense = true;
+    PCL_INFO("Smoothed cloud has %d points, took %g ms\n", output->points.size(), tt.toc());
+}
 
-    pcl::search::KdTree<PointT>::Ptr tree (new pcl::search::KdTree<PointT> ());
-
-    pcl::MovingLeastSquares<PointT, PointT> mls;
-    mls.setInputCloud (cloudToSmooth);
-    mls.setSearchMethod (tree);
-    mls.setComputeNormals (params->MLScomputeNormals);
-    mls.setSearchRadius (params->MLSsearchRadius);
-    mls.setSqrGaussParam (params->MLSsqrGaussParam);
-    mls.setPolynomialFit (params->MLSusePolynomialFit);
-    mls.setPolynomialOrder (params->MLSpolynomialOrder);
-    mls.setUpsamplingRadius (params->MLSupsamplingRadius);
-    mls.setUpsamplingStepSize (params->MLSupsamplingStepSize);
-    mls.setDilationVoxelSize (params->MLSdilationVoxelSize);
-    mls.setUpsamplingMethod (pcl::MovingLeastSquares<PointT, PointT>::VOXEL_GRID_DILATION);
-
-    // Available upsampling methods
-    //  mls.setUpsamplingMethod (pcl::MovingLeastSquares<PointT, PointT>::SAMPLE_LOCAL_PLANE);
-    //  mls.setUpsamplingMethod (pcl::MovingLeastSquares<PointT, PointT>::RANDOM_UNIFORM_DENSITY);
-    //  mls.setUpsamplingMethod (pcl::MovingLeastSquares<PointT, PointT>::VOXEL_GRID_DILATION);
-    //  mls.setUpsamplingMethod (pcl::MovingLeastSquares<PointT, PointT>::NONE);
-
-    PointCloudT::Ptr cloud_smoothed (new PointCloudT ());
-    mls.process (*cloud_smoothed);
-    //output = cloud_smoothed;
-    copyPointCloud(*cloud_smoothed, *output);
-    PCL_INFO("Smoothed cloud has %d points\n", output->points.size());
+/** \brief Smoothing of registered cloud: downsampling, MLS and normal space sampling
+  * \param cloudToSmooth pointer to input cloud
+  * \param output pointer to resultant cloud, may be the input cloud
+  */
+void filters::smoothCloud(PointCloudT::Ptr cloudToSmooth, PointCloudT::Ptr output) {
+    filters::voxelGridFilter(cloudToSmooth, output, 0.02);
+    {
+        progress::section mls(0.0, 0.9);
+        filters::cloudSmoothMLS(output, output);
+    }
+    progress::update(0.9, "Normal space sampling");
+    filters::normalFilter(output, output);
+}
+
+/** \brief Overlap which smoothCloud needs to give same result near chunk borders
+  * \return width of overlap
+  */
+float filters::smoothHalo() {
+    parameters* params = parameters::GetInstance();
+    return params->MLSdilationIterations * params->MLSdilationVoxelSize + params->MLSsearchRadius + 0.02f;
 }
 
 /** \brief Outlier removal
@@ -114,18 +630,389 @@ void filters::oultlierRemoval(PointCloudT::Ptr cloudToFilter, PointCloudT::Ptr f
     rorfilter.filter (*filtered);
 }
 
-/** \brief Smooth organized point cloud with Fast Bilateral Filter
+/** \brief Removes points with too few neighbors in radius without kd-tree,
+  * organized cloud is searched in image window and keeps its structure (outliers become NaN),
+  * unorganized cloud is searched in voxel buckets
+  * \param cloudToFilter pointer to input cloud
+  * \param filtered pointer to resultant cloud, may be the input cloud
+  * \param radius size of neighborhood
+  */
+void filters::fastOutlierRemoval(PointCloudT::Ptr cloudToFilter, PointCloudT::Ptr filtered, float radius) {
+    parameters* params = parameters::GetInstance();
+    pcl::console::TicToc tt;
+    tt.tic();
+    const PointCloudT &cloud = *cloudToFilter;
+    const int size = cloud.points.size();
+    const int minNeighbors = params->OUTminNeighbors;
+    const float sqrRadius = radius * radius;
+    std::vector<char> keep(size, 1);
+
+    if (cloud.isOrganized()) {
+        const int window = params->OUTwindow;
+        const int width = cloud.width;
+        const int height = cloud.height;
+#pragma omp parallel for schedule(dynamic)
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++) {
+                if (pcl::isFinite(cloud(x, y))) {
+                    keep[y * width + x] = organizedInlier(cloud, x, y, window, sqrRadius, minNeighbors);
+                }
+            }
+        }
+    }
+    else {
+        // all points of bucket are within radius from each other
+        const float cell = radius / std::sqrt(3.0f);
+        std::vector<cellKey> keys(size);
+        std::unordered_map<cellKey, std::vector<int>, cellKeyHash> buckets;
+        for (int i = 0; i < size; i++) {
+            const PointT &p = cloud.points[i];
+            if (!pcl::isFinite(p)) {
+                keep[i] = 0;
+                continue;
+            }
+            keys[i].x = static_cast<int>(std::floor(p.x / cell));
+            keys[i].y = static_cast<int>(std::floor(p.y / cell));
+            keys[i].z = static_cast<int>(std::floor(p.z / cell));
+            buckets[keys[i]].push_back(i);
+        }
+
+#pragma omp parallel for schedule(dynamic, 1024)
+        for (int i = 0; i < size; i++) {
+            if (!keep[i]) {
+                continue;
+            }
+            const PointT &p = cloud.points[i];
+            int count = buckets.find(keys[i])->second.size() - 1;
+            for (int dz = -2; dz <= 2 && count < minNeighbors; dz++) {
+                for (int dy = -2; dy <= 2 && count < minNeighbors; dy++) {
+                    for (int dx = -2; dx <= 2 && count < minNeighbors; dx++) {
+                        if (dx == 0 && dy == 0 && dz == 0) {
+                            continue;
+                        }
+                        const cellKey key = {keys[i].x + dx, keys[i].y + dy, keys[i].z + dz};
+                        std::unordered_map<cellKey, std::vector<int>, cellKeyHash>::const_iterator bucket = buckets.find(key);
+                        if (bucket == buckets.end()) {
+                            continue;
+                        }
+                        for (size_t j = 0; j < bucket->second.size() && count < minNeighbors; j++) {
+                            if (withinRadius(p, cloud.points[bucket->second[j]], sqrRadius)) {
+                                count++;
+                            }
+                        }
+                    }
+                }
+            }
+            keep[i] = count >= minNeighbors;
+        }
+    }
+
+    int removed = 0;
+    if (cloud.isOrganized()) {
+        if (filtered != cloudToFilter) {
+            *filtered = cloud;
+        }
+        const float nan = std::numeric_limits<float>::quiet_NaN();
+        for (int i = 0; i < size; i++) {
+            if (!keep[i] && pcl::isFinite(filtered->points[i])) {
+                filtered->points[i].x = filtered->points[i].y = filtered->points[i].z = nan;
+                filtered->is_dense = false;
+                removed++;
+            }
+        }
+    }
+    else {
+        std::vector<PointT, Eigen::aligned_allocator<PointT> > points;
+        points.reserve(size);
+        for (int i = 0; i < size; i++) {
+            if (keep[i]) {
+                points.push_back(cloud.points[i]);
+            }
+        }
+        removed = size - points.size();
+        if (filtered != cloudToFilter) {
+            filtered->header = cloud.header;
+            filtered->sensor_origin_ = cloud.sensor_origin_;
+            filtered->sensor_orientation_ = cloud.sensor_orientation_;
+        }
+        filtered->points.swap(points);
+        filtered->width = filtered->points.size();
+        filtered->height = 1;
+        filtered->is_dense = true;
+    }
+    PCL_INFO("Outlier removal removed %d points in %g ms\n", removed, tt.toc());
+}
+
+/** \brief Compares fast outlier removal with radius outlier removal on given clouds
+  * \param files paths to pcd files
+  * \param radius size of neighborhood
+  * \return 0 if all files were processed
+  */
+int filters::benchmarkOutliers(const std::vector<std::string> &files, float radius) {
+    int failures = 0;
+    for (size_t f = 0; f < files.size(); f++) {
+        PointCloudT::Ptr cloud(new PointCloudT);
+        if (pcl::io::loadPCDFile(files[f], *cloud) < 0) {
+            PCL_INFO("Could not load %s\n", files[f].c_str());
+            failures++;
+            continue;
+        }
+        PointCloudT::Ptr dense(new PointCloudT), reference(new PointCloudT), result(new PointCloudT);
+        std::vector<int> indices;
+        pcl::removeNaNFromPointCloud(*cloud, *dense, indices);
+        pcl::console::TicToc tt;
+
+        tt.tic();
+        filters::oultlierRemoval(dense, reference, radius);
+        const double radiusTime = tt.toc();
+        PCL_INFO("%s: %d points, radius search keeps %d in %g ms\n", files[f].c_str(), dense->points.size(), reference->points.size(), radiusTime);
+
+        tt.tic();
+        filters::fastOutlierRemoval(dense, result, radius);
+        double time = tt.toc();
+        PCL_INFO("%s: voxel buckets keep %d in %g ms, speedup %.2fx\n", files[f].c_str(), result->points.size(), time, radiusTime / time);
+
+        if (cloud->isOrganized()) {
+            tt.tic();
+            filters::fastOutlierRemoval(cloud, result, radius);
+            pcl::removeNaNFromPointCloud(*result, *result, indices);
+            time = tt.toc();
+            PCL_INFO("%s: image window keeps %d in %g ms, speedup %.2fx\n", files[f].c_str(), result->points.size(), time, radiusTime / time);
+        }
+    }
+    return failures == 0 ? 0 : 1;
+}
+
+/** \brief Compares hash voxel grid with pcl::VoxelGrid on given clouds
+  * \param files paths to pcd files
+  * \param leaf size of voxel
+  * \return 0 if all files were processed and both filters keep the same number of voxels
+  */
+int filters::benchmarkVoxelGrid(const std::vector<std::string> &files, float leaf) {
+    int failures = 0;
+    for (size_t f = 0; f < files.size(); f++) {
+        PointCloudT::Ptr cloud(new PointCloudT);
+        if (pcl::io::loadPCDFile(files[f], *cloud) < 0) {
+            PCL_INFO("Could not load %s\n", files[f].c_str());
+            failures++;
+            continue;
+        }
+        failures += benchmarkVoxelGrid(cloud, files[f], leaf) ? 0 : 1;
+    }
+    return failures == 0 ? 0 : 1;
+}
+
+/** \brief Compares hash voxel grid with pcl::VoxelGrid on one cloud
+  * \param cloud input cloud
+  * \param name name of cloud in printed results
+  * \param leaf size of voxel
+  * \return true if both filters keep the same number of voxels
+  */
+bool filters::benchmarkVoxelGrid(const PointCloudT::Ptr &cloud, const std::string &name, float leaf) {
+    PointCloudT::Ptr reference(new PointCloudT), result(new PointCloudT);
+    pcl::console::TicToc tt;
+
+    tt.tic();
+    pcl::VoxelGrid<PointT> ds;
+    ds.setInputCloud (cloud);
+    ds.setLeafSize (leaf, leaf, leaf);
+    ds.filter (*reference);
+    const double pclTime = tt.toc();
+    PCL_INFO("%s: %d points, pcl::VoxelGrid keeps %d in %g ms\n", name.c_str(), cloud->points.size(), reference->points.size(), pclTime);
+
+    tt.tic();
+    filters::voxelGridFilter(cloud, result, leaf);
+    const double time = tt.toc();
+    PCL_INFO("%s: hash voxel grid keeps %d in %g ms, speedup %.2fx\n", name.c_str(), result->points.size(), time, pclTime / time);
+    if (result->points.size() != reference->points.size()) {
+        PCL_INFO("%s: voxel counts differ\n", name.c_str());
+        return false;
+    }
+    return true;
+}
+
+/** \brief Smooth organized point cloud with Fast Bilateral Filter,
+  * same result as pcl::FastBilateralFilter computed on all cores
   * \param cloudToSmooth pointer to input cloud
-  * \param output pointer to resultant cloud
+  * \param output pointer to resultant cloud, may be the input cloud
   */
 void filters::cloudSmoothFBF(PointCloudT::Ptr cloudToSmooth, PointCloudT::Ptr output) {
     PCL_INFO("FBFilter\n");
     parameters* params = parameters::GetInstance();
-    pcl::FastBilateralFilter<PointT> filter;
-    filter.setInputCloud(cloudToSmooth);
-    filter.setSigmaS(params->FBFsigmaS);
-    filter.setSigmaR(params->FBFsigmaR);
-    filter.applyFilter(*output);
+    if (output != cloudToSmooth) {
+        *output = *cloudToSmooth;
+    }
+    if (!output->isOrganized()) {
+        PCL_INFO("FBFilter needs organized cloud, skipping\n");
+        return;
+    }
+
+    pcl::console::TicToc tt;
+    tt.tic();
+    float baseMin, baseMax;
+    if (!depthRange(*output, baseMin, baseMax)) {
+        PCL_INFO("FBFilter got empty cloud\n");
+        return;
+    }
+
+    bilateralGrid grid(output->width, output->height, baseMin, baseMax, params->FBFsigmaS, params->FBFsigmaR);
+    grid.splat(*output);
+    grid.blur();
+#pragma omp parallel for
+    for (int y = 0; y < static_cast<int>(output->height); y++) {
+        grid.sliceRow(*output, y);
+    }
+
+    const double time = tt.toc();
+    PCL_INFO("FBFilter took %g ms (%g fps)\n", time, 1000.0 / time);
+}
+
+/** \brief Preprocesses frame in fused passes over image rows instead of separate filters,
+  * stages run in fixed order: color fix, bilateral smoothing, outlier removal, NaN removal
+  * \param input pointer to input cloud
+  * \param output pointer to resultant cloud, may be the input cloud
+  * \param pipeline names of enabled stages joined by '+' (color, bilateral, outlier, dropNaN)
+  */
+void filters::preprocessFrame(PointCloudT::Ptr input, PointCloudT::Ptr output, const std::string &pipeline) {
+    parameters* params = parameters::GetInstance();
+    bool color = false, bilateral = false, outlier = false, dropNaN = false;
+    std::stringstream stages(pipeline);
+    std::string stage;
+    while (std::getline(stages, stage, '+')) {
+        boost::algorithm::trim(stage);
+        if (stage == "color") color = true;
+        else if (stage == "bilateral") bilateral = true;
+        else if (stage == "outlier") outlier = true;
+        else if (stage == "dropNaN") dropNaN = true;
+        else PCL_INFO("Unknown preprocessing stage %s\n", stage.c_str());
+    }
+
+    pcl::console::TicToc tt;
+    tt.tic();
+    const int size = input->points.size();
+    const bool organized = input->isOrganized();
+    // organized clouds are processed by rows, other clouds by chunks
+    const int rowLength = organized ? std::max(1, static_cast<int>(input->width)) : 4096;
+    const int rows = (size + rowLength - 1) / rowLength;
+
+    if (output != input) {
+        output->header = input->header;
+        output->sensor_origin_ = input->sensor_origin_;
+        output->sensor_orientation_ = input->sensor_orientation_;
+        output->points.resize(size);
+        output->width = input->width;
+        output->height = input->height;
+        output->is_dense = input->is_dense;
+    }
+    PointCloudT &cloud = *output;
+
+    // pass 1: copy, color fix and depth range
+    float baseMin = std::numeric_limits<float>::max();
+    float baseMax = -std::numeric_limits<float>::max();
+    const PointT *src = size ? &input->points[0] : NULL;
+    PointT *dst = size ? &cloud.points[0] : NULL;
+#pragma omp parallel for reduction(max:baseMax) reduction(min:baseMin)
+    for (int i = 0; i < size; i++) {
+        PointT p = src[i];
+        if (color) {
+            p.a = 255;
+            if (p.r == 0 && p.g == 0 && p.b == 0) {
+                p.r = 127;
+                p.g = 127;
+                p.b = 127;
+            }
+        }
+        if (std::isfinite(p.z)) {
+            baseMax = std::max(baseMax, p.z);
+            baseMin = std::min(baseMin, p.z);
+        }
+        dst[i] = p;
+    }
+
+    boost::shared_ptr<bilateralGrid> grid;
+    if (bilateral && organized && baseMin <= baseMax) {
+        grid.reset(new bilateralGrid(cloud.width, cloud.height, baseMin, baseMax, params->FBFsigmaS, params->FBFsigmaR));
+        grid->splat(cloud);
+        grid->blur();
+    }
+
+    // pass 2: slice rows, then decide about outliers while rows are still in cache
+    const bool organizedOutlier = outlier && params->OUTfast && organized;
+    const float sqrRadius = params->PREoutlierRadius * params->PREoutlierRadius;
+    std::vector<char> keep;
+    if (organizedOutlier) {
+        keep.assign(size, 1);
+    }
+#pragma omp parallel
+    {
+        if (grid) {
+#pragma omp for
+            for (int y = 0; y < rows; y++) {
+                grid->sliceRow(cloud, y);
+            }
+        }
+        if (organizedOutlier) {
+#pragma omp for
+            for (int y = 0; y < rows; y++) {
+                for (int x = 0; x < rowLength; x++) {
+                    if (pcl::isFinite(cloud(x, y))) {
+                        keep[y * rowLength + x] = organizedInlier(cloud, x, y, params->OUTwindow, sqrRadius, params->OUTminNeighbors);
+                    }
+                }
+            }
+        }
+    }
+
+    // pass 3: drop NaNs and outliers, rows are compacted in parallel to one new buffer
+    if (dropNaN) {
+        std::vector<int> rowStart(rows + 1, 0);
+#pragma omp parallel for
+        for (int r = 0; r < rows; r++) {
+            int count = 0;
+            for (int i = r * rowLength; i < std::min(size, (r + 1) * rowLength); i++) {
+                count += pcl::isFinite(cloud.points[i]) && (keep.empty() || keep[i]);
+            }
+            rowStart[r + 1] = count;
+        }
+        for (int r = 0; r < rows; r++) {
+            rowStart[r + 1] += rowStart[r];
+        }
+
+        std::vector<PointT, Eigen::aligned_allocator<PointT> > points(rowStart[rows]);
+#pragma omp parallel for
+        for (int r = 0; r < rows; r++) {
+            int j = rowStart[r];
+            for (int i = r * rowLength; i < std::min(size, (r + 1) * rowLength); i++) {
+                if (pcl::isFinite(cloud.points[i]) && (keep.empty() || keep[i])) {
+                    points[j++] = cloud.points[i];
+                }
+            }
+        }
+        cloud.points.swap(points);
+        cloud.width = cloud.points.size();
+        cloud.height = 1;
+        cloud.is_dense = true;
+    }
+    else if (organizedOutlier) {
+        const float nan = std::numeric_limits<float>::quiet_NaN();
+#pragma omp parallel for
+        for (int i = 0; i < size; i++) {
+            if (!keep[i]) {
+                cloud.points[i].x = cloud.points[i].y = cloud.points[i].z = nan;
+            }
+        }
+        cloud.is_dense = false;
+    }
+
+    if (outlier && !organizedOutlier) {
+        if (params->OUTfast) {
+            filters::fastOutlierRemoval(output, output, params->PREoutlierRadius);
+        }
+        else {
+            filters::oultlierRemoval(output, output, params->PREoutlierRadius);
+        }
+    }
+    PCL_INFO("Preprocessing %s: %d -> %d points in %g ms\n", pipeline.c_str(), size, cloud.points.size(), tt.toc());
 }
 
 /** \brief Experimental bilateral upsampling
@@ -134,7 +1021,7 @@ void filters::cloudSmoothFBF(PointCloudT::Ptr cloudToSmooth, PointCloudT::Ptr ou
   */
 void filters::bilatelarUpsampling(PointCloudT::Ptr cloudToSmooth, PointCloudT::Ptr output) {
     pcl::BilateralUpsampling<PointT, PointT> bu;
-    PointCloudT::Ptr tmp (new PointCloudT);
+    PointCloudT::Ptr tmp = pool::cloud();
     pcl::copyPointCloud(*cloudToSmooth, *tmp);
     bu.setInputCloud (cloudToSmooth);
 
@@ -168,16 +1055,7 @@ void filters::bilatelarUpsampling(PointCloudT::Ptr cloudToSmooth, PointCloudT::P
   */
 void filters::normalFilter(PointCloudT::Ptr input, PointCloudT::Ptr output) {
     PCL_INFO("normalFilter\n");
-    pcl::NormalEstimation<PointT, pcl::Normal> ne;
-    ne.setInputCloud (input);
-    pcl::search::KdTree<PointT>::Ptr tree (new pcl::search::KdTree<PointT> ());
-    ne.setSearchMethod (tree);
-    pcl::PointCloud<pcl::Normal>::Ptr cloud_normals (new pcl::PointCloud<pcl::Normal>);
-    ne.setRadiusSearch (0.02);
-    ne.compute (*cloud_normals);
-
-    PointCloudRGBNT::Ptr temp(new PointCloudRGBNT);
-    pcl::concatenateFields (*input, *cloud_normals, *temp);
+    PointCloudRGBNT::Ptr temp = cache::withNormals (input, 0, 0.02f);
 
     pcl::NormalSpaceSampling<NormalRGBT, NormalRGBT> normal_space_sampling;
     normal_space_sampling.setInputCloud (temp);
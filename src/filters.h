@@ -20,6 +20,8 @@
 
 #include "types.h"
 #include "parameters.h"
+#include "cache.h"
+#include "progress.h"
 #include <pcl/filters/voxel_grid.h>
 #include <iostream>
 #include "boost/property_tree/ptree.hpp"
@@ -43,8 +45,15 @@ public:
     static void voxelGridFilter(PointCloudT::Ptr cloudToFilter, PointCloudT::Ptr filtered, float leaf = -1.0f);
     static void downsample (const PointCloudT::Ptr &input,  PointCloudT &output, double radius);
     static void cloudSmoothMLS(PointCloudT::Ptr cloudToSmooth, PointCloudT::Ptr output);
+    static void smoothCloud(PointCloudT::Ptr cloudToSmooth, PointCloudT::Ptr output);
+    static float smoothHalo();
     static void cloudSmoothFBF(PointCloudT::Ptr cloudToSmooth, PointCloudT::Ptr output);
+    static void preprocessFrame(PointCloudT::Ptr input, PointCloudT::Ptr output, const std::string &pipeline);
     static void oultlierRemoval(PointCloudT::Ptr cloudToFilter, PointCloudT::Ptr filtered, float radius);
+    static void fastOutlierRemoval(PointCloudT::Ptr cloudToFilter, PointCloudT::Ptr filtered, float radius);
+    static int benchmarkOutliers(const std::vector<std::string> &files, float radius);
+    static int benchmarkVoxelGrid(const std::vector<std::string> &files, float leaf);
+    static bool benchmarkVoxelGrid(const PointCloudT::Ptr &cloud, const std::string &name, float leaf);
     static void bilatelarUpsampling(PointCloudT::Ptr cloudToSmooth, PointCloudT::Ptr output);
     static void normalFilter(PointCloudT::Ptr input, PointCloudT::Ptr output);
 };
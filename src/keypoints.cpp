@@ -0,0 +1,381 @@
+/*
+    This file is part of RoomScanner.
+
+    RoomScanner is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    RoomScanner is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with RoomScanner.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "keypoints.h"
+#include "filters.h"
+#include <pcl/keypoints/impl/sift_keypoint.hpp>
+#include <pcl/io/pcd_io.h>
+#include <pcl/filters/filter.h>
+#include <pcl/common/time.h>
+#include <boost/algorithm/string/trim.hpp>
+#include <sstream>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+
+/** \brief Finds 3D SIFT keypoints, same result as pcl::SIFTKeypoint
+  * \param cloud input point cloud
+  * \param result resultant keypoints with their scales
+  * \param minScale standard deviation of the smallest scale
+  * \param nOctaves number of octaves
+  * \param nScalesPerOctave number of scales computed for each octave
+  * \param minContrast minimum contrast required for detection
+  */
+void keypoints::sift(const PointCloudT::Ptr &cloud, pcl::PointCloud<pcl::PointWithScale> &result,
+                     float minScale, int nOctaves, int nScalesPerOctave, float minContrast) {
+    const int K = EXTREMA_NEIGHBORS;
+    const size_t minPoints = 25;
+    pcl::SIFTKeypointFieldSelector<PointT> getFieldValue;
+    result.clear();
+
+    // octaves are downsampled from each other, build them up front
+    std::vector<octave> octaves;
+    PointCloudT::Ptr level(new PointCloudT(*cloud));
+    float scale = minScale;
+    for (int o = 0; o < nOctaves; o++) {
+        pcl::VoxelGrid<PointT> grid;
+        grid.setLeafSize(scale, scale, scale);
+        grid.setInputCloud(level);
+        PointCloudT::Ptr downsampled(new PointCloudT);
+        grid.filter(*downsampled);
+        level = downsampled;
+        if (level->points.size() < minPoints) {
+            break;
+        }
+
+        octaves.push_back(octave());
+        octave &oct = octaves.back();
+        oct.cloud = level;
+        oct.scales.resize(nScalesPerOctave + 3);
+        for (int s = 0; s <= nScalesPerOctave + 2; s++) {
+            oct.scales[s] = scale * powf(2.0f, (1.0f * static_cast<float>(s) - 1.0f) / static_cast<float>(nScalesPerOctave));
+        }
+        scale *= 2;
+    }
+
+    std::vector<int> offset(octaves.size() + 1, 0);
+    for (size_t o = 0; o < octaves.size(); o++) {
+        offset[o + 1] = offset[o] + octaves[o].cloud->points.size();
+    }
+    const int total = offset.back();
+
+#pragma omp parallel for schedule(dynamic)
+    for (int o = 0; o < static_cast<int>(octaves.size()); o++) {
+        octave &oct = octaves[o];
+        oct.tree.reset(new pcl::search::KdTree<PointT>(true));
+        oct.tree->setInputCloud(oct.cloud);
+        oct.dog.resize(oct.cloud->points.size(), oct.scales.size() - 1);
+        oct.nearest.resize(oct.cloud->points.size() * K);
+        oct.nearestValid.assign(oct.cloud->points.size(), 0);
+    }
+
+    // difference of gaussians, one radius search per point serves all scales of octave
+#pragma omp parallel
+    {
+        std::vector<int> nn_indices;
+        std::vector<float> nn_dist;
+        std::vector<float> sigma_sqr;
+
+#pragma omp for schedule(dynamic, 256)
+        for (int g = 0; g < total; g++) {
+            const int o = std::upper_bound(offset.begin(), offset.end(), g) - offset.begin() - 1;
+            octave &oct = octaves[o];
+            const int i = g - offset[o];
+            const PointCloudT &input = *oct.cloud;
+
+            sigma_sqr.resize(oct.scales.size());
+            for (size_t s = 0; s < oct.scales.size(); s++) {
+                sigma_sqr[s] = powf(oct.scales[s], 2.0f);
+            }
+
+            const float max_radius = 3.0f * oct.scales.back();
+            oct.tree->radiusSearch(i, max_radius, nn_indices, nn_dist);
+
+            float filter_response = 0.0f;
+            float previous_filter_response;
+            for (size_t s = 0; s < oct.scales.size(); s++) {
+                float numerator = 0.0f;
+                float denominator = 0.0f;
+                for (size_t n = 0; n < nn_indices.size(); n++) {
+                    const float value = getFieldValue(input.points[nn_indices[n]]);
+                    const float &dist_sqr = nn_dist[n];
+                    if (dist_sqr <= 9 * sigma_sqr[s]) {
+                        float w = expf(-0.5f * dist_sqr / sigma_sqr[s]);
+                        numerator += value * w;
+                        denominator += w;
+                    }
+                    else {
+                        break;
+                    }
+                }
+                previous_filter_response = filter_response;
+                filter_response = numerator / denominator;
+                if (s > 0) {
+                    oct.dog(i, s - 1) = filter_response - previous_filter_response;
+                }
+            }
+
+            // sorted radius result holds the k nearest neighbors if the k-th is strictly closer than the next
+            if (static_cast<int>(nn_indices.size()) > K && nn_dist[K - 1] < nn_dist[K]) {
+                std::copy(nn_indices.begin(), nn_indices.begin() + K, oct.nearest.begin() + i * K);
+                oct.nearestValid[i] = 1;
+            }
+        }
+    }
+
+    // extrema in scale space, collected per point to keep serial order
+    std::vector<std::pair<int, int> > extrema;
+#pragma omp parallel
+    {
+        std::vector<int> knn_indices(K);
+        std::vector<float> knn_dist(K);
+        std::vector<float> min_val, max_val;
+        std::vector<std::pair<int, int> > local;
+
+#pragma omp for schedule(dynamic, 256) nowait
+        for (int g = 0; g < total; g++) {
+            const int o = std::upper_bound(offset.begin(), offset.end(), g) - offset.begin() - 1;
+            const octave &oct = octaves[o];
+            const int i = g - offset[o];
+            const int nr_scales = static_cast<int>(oct.dog.cols());
+
+            const int *nn;
+            size_t nr_nn;
+            if (oct.nearestValid[i]) {
+                nn = &oct.nearest[i * K];
+                nr_nn = K;
+            }
+            else {
+                nr_nn = oct.tree->nearestKSearch(i, K, knn_indices, knn_dist);
+                nn = &knn_indices[0];
+            }
+
+            min_val.resize(nr_scales);
+            max_val.resize(nr_scales);
+            for (int s = 0; s < nr_scales; s++) {
+                min_val[s] = std::numeric_limits<float>::max();
+                max_val[s] = -std::numeric_limits<float>::max();
+                for (size_t n = 0; n < nr_nn; n++) {
+                    const float &d = oct.dog(nn[n], s);
+                    min_val[s] = (std::min)(min_val[s], d);
+                    max_val[s] = (std::max)(max_val[s], d);
+                }
+            }
+
+            for (int s = 1; s < nr_scales - 1; s++) {
+                const float &val = oct.dog(i, s);
+                if (fabs(val) >= minContrast) {
+                    if ((val == min_val[s]) && (val < min_val[s - 1]) && (val < min_val[s + 1])) {
+                        local.push_back(std::make_pair(g, s));
+                    }
+                    else if ((val == max_val[s]) && (val > max_val[s - 1]) && (val > max_val[s + 1])) {
+                        local.push_back(std::make_pair(g, s));
+                    }
+                }
+            }
+        }
+#pragma omp critical
+        extrema.insert(extrema.end(), local.begin(), local.end());
+    }
+    std::sort(extrema.begin(), extrema.end());
+
+    result.points.reserve(extrema.size());
+    for (size_t e = 0; e < extrema.size(); e++) {
+        const int g = extrema[e].first;
+        const int o = std::upper_bound(offset.begin(), offset.end(), g) - offset.begin() - 1;
+        const PointT &p = octaves[o].cloud->points[g - offset[o]];
+        pcl::PointWithScale keypoint;
+        keypoint.x = p.x;
+        keypoint.y = p.y;
+        keypoint.z = p.z;
+        keypoint.scale = octaves[o].scales[extrema[e].second];
+        result.points.push_back(keypoint);
+    }
+
+    result.height = 1;
+    result.width = static_cast<uint32_t>(result.points.size());
+    result.header = cloud->header;
+    result.sensor_origin_ = cloud->sensor_origin_;
+    result.sensor_orientation_ = cloud->sensor_orientation_;
+}
+
+/** \brief Finds 3D SIFT keypoints with parameters from config
+  * \param cloud input point cloud
+  * \param result resultant keypoints
+  */
+void keypoints::sift(const PointCloudT::Ptr &cloud, PointCloudT &result) {
+    parameters* params = parameters::GetInstance();
+    pcl::PointCloud<pcl::PointWithScale> scaled;
+    sift(cloud, scaled, params->SIFTmin_scale, params->SIFTn_octaves, params->SIFTn_scales_per_octave, params->SIFTmin_contrast);
+    copyPointCloud(scaled, result); // from PointWithScale to PointCloudT
+}
+
+/** \brief Finds ISS keypoints with parameters from config
+  * \param cloud input point cloud
+  * \param result resultant keypoints
+  */
+void keypoints::iss(const PointCloudT::Ptr &cloud, PointCloudT &result) {
+    parameters* params = parameters::GetInstance();
+    pcl::ISSKeypoint3D<PointT, PointT> iss;
+    pcl::search::KdTree<PointT>::Ptr tree(new pcl::search::KdTree<PointT> ());
+    iss.setSearchMethod(tree);
+    iss.setSalientRadius(params->ISSsalientRadius);
+    iss.setNonMaxRadius(params->ISSnonMaxRadius);
+    iss.setThreshold21(params->ISSgamma21);
+    iss.setThreshold32(params->ISSgamma32);
+    iss.setMinNeighbors(params->ISSminNeighbors);
+    iss.setNumberOfThreads(4);
+    iss.setInputCloud(cloud);
+    iss.compute(result);
+}
+
+/** \brief Finds Harris 3D keypoints with parameters from config
+  * \param cloud input point cloud
+  * \param result resultant keypoints
+  */
+void keypoints::harris(const PointCloudT::Ptr &cloud, PointCloudT &result) {
+    parameters* params = parameters::GetInstance();
+    pcl::HarrisKeypoint3D<PointT, pcl::PointXYZI> harris;
+    pcl::PointCloud<pcl::PointXYZI> response;
+    harris.setRadius(params->HARradius);
+    harris.setThreshold(params->HARthreshold);
+    harris.setNonMaxSupression(params->HARnonMaxSupression);
+    harris.setRefine(false);
+    harris.setNumberOfThreads(4);
+    harris.setInputCloud(cloud);
+    harris.compute(response);
+
+    copyPointCloud(response, result); // from PointXYZI to PointCloudT
+}
+
+/** \brief Uses uniform grid of points as keypoints
+  * \param cloud input point cloud
+  * \param result resultant keypoints
+  */
+void keypoints::uniform(const PointCloudT::Ptr &cloud, PointCloudT &result) {
+    parameters* params = parameters::GetInstance();
+    filters::downsample(cloud, result, params->KEYuniformRadius);
+}
+
+/** \brief Runs keypoint detectors selected in config and joins their results
+  * \param cloud input point cloud
+  * \param result resultant keypoints
+  */
+void keypoints::detect(const PointCloudT::Ptr &cloud, PointCloudT &result) {
+    parameters* params = parameters::GetInstance();
+    std::stringstream detectors(params->KEYdetector);
+    std::string name;
+    result.clear();
+
+    while (std::getline(detectors, name, '+')) {
+        boost::algorithm::trim(name);
+        PointCloudT found;
+        pcl::console::TicToc tt;
+        tt.tic();
+
+        if (name == "sift") {
+            sift(cloud, found);
+        }
+        else if (name == "iss") {
+            iss(cloud, found);
+        }
+        else if (name == "harris") {
+            harris(cloud, found);
+        }
+        else if (name == "uniform") {
+            uniform(cloud, found);
+        }
+        else {
+            PCL_INFO("Unknown keypoint detector %s\n", name.c_str());
+            continue;
+        }
+
+        PCL_INFO("%s: %d keypoints in %.1f ms\n", name.c_str(), found.points.size(), tt.toc());
+        result += found;
+    }
+}
+
+/** \brief Compares parallel SIFT with pcl::SIFTKeypoint on given clouds
+  * \param files paths to pcd files
+  * \return 0 if results of both detectors are identical
+  */
+int keypoints::benchmark(const std::vector<std::string> &files) {
+    int mismatches = 0;
+    for (size_t f = 0; f < files.size(); f++) {
+        PointCloudT::Ptr raw(new PointCloudT);
+        if (pcl::io::loadPCDFile(files[f], *raw) < 0) {
+            PCL_INFO("Could not load %s\n", files[f].c_str());
+            mismatches++;
+            continue;
+        }
+        mismatches += benchmark(raw, files[f]);
+    }
+    return mismatches == 0 ? 0 : 1;
+}
+
+/** \brief Compares parallel SIFT with pcl::SIFTKeypoint on cloud as loaded and as seen by registration
+  * \param cloud input cloud, NaN points are removed in place
+  * \param name name of cloud in printed results
+  * \return number of inputs on which results of detectors differ
+  */
+int keypoints::benchmark(const PointCloudT::Ptr &cloud, const std::string &name) {
+    parameters* params = parameters::GetInstance();
+    int mismatches = 0;
+
+    std::vector<int> indices;
+    cloud->is_dense = false;
+    pcl::removeNaNFromPointCloud(*cloud, *cloud, indices);
+
+    // as loaded and as seen by registration
+    PointCloudT::Ptr registrationInput(new PointCloudT);
+    filters::voxelGridFilter(cloud, registrationInput, 0.02f);
+    PointCloudT::Ptr inputs[2] = {cloud, registrationInput};
+    const char *names[2] = {"raw", "voxel 0.02"};
+
+    for (int v = 0; v < 2; v++) {
+        pcl::PointCloud<pcl::PointWithScale> reference, result;
+        pcl::console::TicToc tt;
+
+        tt.tic();
+        pcl::SIFTKeypoint<PointT, pcl::PointWithScale> sift;
+        pcl::search::KdTree<PointT>::Ptr tree(new pcl::search::KdTree<PointT> ());
+        sift.setSearchMethod(tree);
+        sift.setScales(params->SIFTmin_scale, params->SIFTn_octaves, params->SIFTn_scales_per_octave);
+        sift.setMinimumContrast(params->SIFTmin_contrast);
+        sift.setInputCloud(inputs[v]);
+        sift.compute(reference);
+        const double serialTime = tt.toc();
+
+        tt.tic();
+        keypoints::sift(inputs[v], result, params->SIFTmin_scale, params->SIFTn_octaves, params->SIFTn_scales_per_octave, params->SIFTmin_contrast);
+        const double parallelTime = tt.toc();
+
+        bool identical = reference.points.size() == result.points.size();
+        for (size_t i = 0; identical && i < result.points.size(); i++) {
+            identical = reference.points[i].x == result.points[i].x && reference.points[i].y == result.points[i].y &&
+                        reference.points[i].z == result.points[i].z && reference.points[i].scale == result.points[i].scale;
+        }
+        if (!identical) {
+            mismatches++;
+        }
+
+        PCL_INFO("%s (%s): %d points, %d keypoints, pcl %.1f ms, parallel %.1f ms, speedup %.2fx, %s\n",
+                 name.c_str(), names[v], inputs[v]->points.size(), result.points.size(),
+                 serialTime, parallelTime, serialTime / parallelTime, identical ? "identical" : "DIFFERENT");
+    }
+    return mismatches;
+}
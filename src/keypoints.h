@@ -0,0 +1,61 @@
+/*
+    This file is part of RoomScanner.
+
+    RoomScanner is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    RoomScanner is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with RoomScanner.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef KEYPOINTS_H
+#define KEYPOINTS_H
+
+#include "types.h"
+#include "parameters.h"
+#include <pcl/keypoints/sift_keypoint.h>
+#include <pcl/filters/voxel_grid.h>
+#include <pcl/keypoints/iss_3d.h>
+#include <pcl/keypoints/harris_3d.h>
+#include <pcl/search/kdtree.h>
+#include <vector>
+#include <string>
+
+// Keypoint detectors running on all cores.
+class keypoints
+{
+public:
+    static void sift(const PointCloudT::Ptr &cloud, pcl::PointCloud<pcl::PointWithScale> &result,
+                     float minScale, int nOctaves, int nScalesPerOctave, float minContrast);
+    static void sift(const PointCloudT::Ptr &cloud, PointCloudT &result);
+    static void iss(const PointCloudT::Ptr &cloud, PointCloudT &result);
+    static void harris(const PointCloudT::Ptr &cloud, PointCloudT &result);
+    static void uniform(const PointCloudT::Ptr &cloud, PointCloudT &result);
+    static void detect(const PointCloudT::Ptr &cloud, PointCloudT &result);
+
+    static int benchmark(const std::vector<std::string> &files);
+    static int benchmark(const PointCloudT::Ptr &cloud, const std::string &name);
+
+private:
+    // one downsampled level of the scale space
+    struct octave {
+        PointCloudT::Ptr cloud;
+        pcl::search::KdTree<PointT>::Ptr tree;
+        std::vector<float> scales;
+        Eigen::MatrixXf dog;
+        // 25 nearest neighbors of each point if known from the radius search
+        std::vector<int> nearest;
+        std::vector<char> nearestValid;
+    };
+
+    static const int EXTREMA_NEIGHBORS = 25;
+};
+
+#endif // KEYPOINTS_H
@@ -0,0 +1,435 @@
+/*
+    This file is part of RoomScanner.
+
+    RoomScanner is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    RoomScanner is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with RoomScanner.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "lod.h"
+#include <vtkLODActor.h>
+#include <vtkProperty.h>
+#include <vtkMapper.h>
+#include <vtkUnsignedCharArray.h>
+#include <algorithm>
+#include <queue>
+#include <random>
+#include <cmath>
+#include <limits>
+
+namespace {
+
+// points kept by node that has children, one per cell of grid over its cube
+const int SAMPLE_GRID = 16;
+// nodes with fewer points are leaves
+const size_t NODE_POINTS = SAMPLE_GRID * SAMPLE_GRID * SAMPLE_GRID;
+const int MAX_DEPTH = 20;
+// displayed color of black points
+const unsigned char BLACK_SHOWN = 127;
+
+bool visible(const lod::node &n, const lod::view &camera) {
+    const float radius = n.half * std::sqrt(3.0f);
+    const Eigen::Vector3f d = n.center - camera.position;
+    const float z = d.dot(camera.forward);
+    if (z < camera.nearClip - radius) {
+        return false;
+    }
+    // distance of sphere center to side planes of frustum
+    return std::abs(d.dot(camera.right)) <= z * camera.tanX + radius * std::sqrt(1.0f + camera.tanX * camera.tanX)
+        && std::abs(d.dot(camera.up)) <= z * camera.tanY + radius * std::sqrt(1.0f + camera.tanY * camera.tanY);
+}
+
+// projected distance of node samples in pixels
+float spacing(const lod::node &n, const lod::view &camera) {
+    const float radius = n.half * std::sqrt(3.0f);
+    const float distance = std::max((n.center - camera.position).norm() - radius, camera.nearClip);
+    return 2.0f * n.half / SAMPLE_GRID / distance * camera.pixels;
+}
+
+}
+
+/** \brief Creates level of detail layer of viewer
+  * \param viewer viewer the layer renders to, refresh is called from its thread
+  */
+lod::lod(const boost::shared_ptr<pcl::visualization::PCLVisualizer> &viewer)
+    : viewer(viewer)
+{
+}
+
+/** \brief Displays cloud or replaces displayed one with same id, octree is built on calling thread
+  * \param cloud input cloud, it has to stay unchanged while displayed
+  * \param id name of cloud in viewer
+  */
+void lod::show(const PointCloudT::ConstPtr &cloud, const std::string &id) {
+    boost::shared_ptr<tree> octree(new tree);
+    build(cloud, *octree);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    layer *target = NULL;
+    for (size_t i = 0; i < layers.size(); i++) {
+        if (layers[i].id == id) {
+            target = &layers[i];
+        }
+    }
+    if (target == NULL) {
+        layers.push_back(layer());
+        target = &layers.back();
+        target->id = id;
+    }
+    target->octree = octree;
+    target->camera.clear();
+    target->budget = 0;
+    target->complete = false;
+    target->changed = true;
+}
+
+/** \brief Removes cloud from viewer at next refresh
+  * \param id name of cloud in viewer
+  */
+void lod::hide(const std::string &id) {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (size_t i = 0; i < layers.size(); i++) {
+        if (layers[i].id == id) {
+            layers.erase(layers.begin() + i);
+            break;
+        }
+    }
+    removed.push_back(id);
+}
+
+/** \brief Removes all clouds of layer from viewer at next refresh
+  */
+void lod::clear() {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (size_t i = 0; i < layers.size(); i++) {
+        removed.push_back(layers[i].id);
+    }
+    layers.clear();
+}
+
+/** \brief Streams points for current camera to viewer, called periodically from thread of viewer.
+  * Moving camera gets interactive budget, idle camera doubles it up to full budget.
+  * \return true if viewer has to be rendered again
+  */
+bool lod::refresh() {
+    parameters* params = parameters::GetInstance();
+    std::lock_guard<std::mutex> lock(mutex);
+    bool updated = false;
+    for (size_t i = 0; i < removed.size(); i++) {
+        if (viewer->contains(removed[i])) {
+            viewer->removePointCloud(removed[i]);
+            updated = true;
+        }
+    }
+    removed.clear();
+    if (layers.empty()) {
+        return updated;
+    }
+
+    pcl::visualization::Camera camera;
+    viewer->getCameraParameters(camera);
+    std::vector<double> state(camera.pos, camera.pos + 3);
+    state.insert(state.end(), camera.focal, camera.focal + 3);
+    state.insert(state.end(), camera.view, camera.view + 3);
+    state.insert(state.end(), camera.window_size, camera.window_size + 2);
+    state.push_back(camera.fovy);
+    const view current = fromCamera(camera);
+
+    const size_t interactive = std::max(params->LODinteractive, 1);
+    const size_t full = std::max(params->LODbudget, params->LODinteractive);
+    for (size_t i = 0; i < layers.size(); i++) {
+        layer &l = layers[i];
+        size_t budget;
+        if (l.changed) {
+            budget = interactive;
+        }
+        else if (l.camera != state) {
+            l.camera = state;
+            if (l.complete) {
+                continue;
+            }
+            budget = interactive;
+        }
+        else if (l.complete || l.budget >= full) {
+            continue;
+        }
+        else {
+            budget = std::min(2 * l.budget, full);
+        }
+
+        PointCloudT::Ptr selected(new PointCloudT);
+        l.complete = select(*l.octree, current, budget, params->LODpixelSpacing, *selected);
+        // spacing or view limited selection, bigger budget adds nothing
+        l.budget = (selected->points.size() + NODE_POINTS < budget) ? full : budget;
+        l.camera = state;
+        l.changed = false;
+        colorHandler colors(selected);
+        if (viewer->contains(l.id)) {
+            viewer->updatePointCloud(selected, colors, l.id);
+        }
+        else {
+            viewer->addPointCloud(selected, colors, l.id);
+        }
+        apply(l.id);
+        updated = true;
+    }
+    return updated;
+}
+
+/** \brief Sets render properties of cloud, they are kept for the id while cloud is hidden too,
+  * called from thread of viewer
+  * \param id name of cloud in viewer
+  * \param look render properties
+  */
+void lod::setStyle(const std::string &id, const style &look) {
+    std::lock_guard<std::mutex> lock(mutex);
+    styles[id] = look;
+    apply(id);
+}
+
+/** \brief Applies render properties again after cloud not managed by layer was added or updated,
+  * called from thread of viewer
+  * \param id name of cloud in viewer
+  */
+void lod::applyStyle(const std::string &id) {
+    std::lock_guard<std::mutex> lock(mutex);
+    apply(id);
+}
+
+/** \brief Sets render properties of actor of cloud if it has any, cost does not depend on cloud size
+  * \param id name of cloud in viewer
+  */
+void lod::apply(const std::string &id) {
+    std::map<std::string, style>::const_iterator look = styles.find(id);
+    if (look == styles.end()) {
+        return;
+    }
+    pcl::visualization::CloudActorMapPtr actors = viewer->getCloudActorMap();
+    pcl::visualization::CloudActorMap::iterator it = actors->find(id);
+    if (it == actors->end()) {
+        return;
+    }
+    vtkLODActor *actor = it->second.actor;
+    actor->GetProperty()->SetOpacity(look->second.opacity);
+    actor->GetProperty()->SetPointSize(look->second.pointSize);
+    actor->GetProperty()->SetColor(look->second.r, look->second.g, look->second.b);
+    actor->GetMapper()->SetScalarVisibility(!look->second.colored);
+    actor->Modified();
+}
+
+/** \brief Creates handler of colors uploaded to viewer
+  * \param cloud displayed cloud
+  */
+lod::colorHandler::colorHandler(const PointCloudT::ConstPtr &cloud)
+    : pcl::visualization::PointCloudColorHandler<PointT>(cloud)
+{
+    capable_ = true;
+}
+
+/** \brief Fills colors of finite points in the order viewer uploads them
+  * \param scalars resultant colors
+  */
+bool lod::colorHandler::getColor(vtkSmartPointer<vtkDataArray> &scalars) const {
+    if (!cloud_) {
+        return false;
+    }
+    vtkSmartPointer<vtkUnsignedCharArray> colors = vtkSmartPointer<vtkUnsignedCharArray>::New();
+    colors->SetNumberOfComponents(3);
+    colors->SetNumberOfTuples(cloud_->points.size());
+    unsigned char *rgb = colors->GetPointer(0);
+    vtkIdType count = 0;
+    for (size_t i = 0; i < cloud_->points.size(); i++) {
+        const PointT &p = cloud_->points[i];
+        if (!cloud_->is_dense && !pcl::isFinite(p)) {
+            continue;
+        }
+        const bool black = (p.r == 0 && p.g == 0 && p.b == 0);
+        rgb[3 * count] = black ? BLACK_SHOWN : p.r;
+        rgb[3 * count + 1] = black ? BLACK_SHOWN : p.g;
+        rgb[3 * count + 2] = black ? BLACK_SHOWN : p.b;
+        count++;
+    }
+    colors->SetNumberOfTuples(count);
+    scalars = colors;
+    return true;
+}
+
+/** \brief Sorts finite points of cloud into octree, every node keeps first point falling
+  * into each cell of grid over its cube, points are shuffled before so the sample is uniform
+  * \param cloud input cloud
+  * \param result resultant octree referencing the cloud
+  */
+void lod::build(const PointCloudT::ConstPtr &cloud, tree &result) {
+    result.cloud = cloud;
+    result.order.clear();
+    result.nodes.clear();
+    result.order.reserve(cloud->points.size());
+    Eigen::Vector3f minimum = Eigen::Vector3f::Constant(std::numeric_limits<float>::max());
+    Eigen::Vector3f maximum = -minimum;
+    for (size_t i = 0; i < cloud->points.size(); i++) {
+        if (pcl::isFinite(cloud->points[i])) {
+            result.order.push_back(i);
+            minimum = minimum.cwiseMin(cloud->points[i].getVector3fMap());
+            maximum = maximum.cwiseMax(cloud->points[i].getVector3fMap());
+        }
+    }
+    if (result.order.empty()) {
+        return;
+    }
+    std::shuffle(result.order.begin(), result.order.end(), std::mt19937(0));
+
+    node root;
+    root.center = (minimum + maximum) / 2;
+    root.half = std::max((maximum - minimum).maxCoeff() / 2, std::numeric_limits<float>::epsilon()) * 1.001f;
+    result.nodes.push_back(root);
+    split(result, 0, 0, result.order.size(), 0);
+    PCL_INFO("Octree of %d points has %d nodes\n", result.order.size(), result.nodes.size());
+}
+
+/** \brief Keeps sample of node points and distributes the rest to its children
+  * \param octree octree being built
+  * \param index index of node
+  * \param begin first point of node in order
+  * \param end end of node points in order
+  * \param depth depth of node
+  */
+void lod::split(tree &octree, int index, size_t begin, size_t end, int depth) {
+    const Eigen::Vector3f center = octree.nodes[index].center;
+    const float half = octree.nodes[index].half;
+    std::fill(octree.nodes[index].children, octree.nodes[index].children + 8, -1);
+    octree.nodes[index].begin = begin;
+    octree.nodes[index].end = end;
+    if (end - begin <= NODE_POINTS || depth >= MAX_DEPTH) {
+        return;
+    }
+
+    std::vector<int> &order = octree.order;
+    const PointCloudT &cloud = *octree.cloud;
+    const Eigen::Vector3f corner = center - Eigen::Vector3f::Constant(half);
+    const float scale = SAMPLE_GRID / (2 * half);
+    std::vector<bool> taken(SAMPLE_GRID * SAMPLE_GRID * SAMPLE_GRID, false);
+    size_t middle = begin;
+    for (size_t i = begin; i < end; i++) {
+        const Eigen::Vector3i cell = ((cloud.points[order[i]].getVector3fMap() - corner) * scale).cast<int>()
+                .cwiseMax(0).cwiseMin(SAMPLE_GRID - 1);
+        const int key = (cell.z() * SAMPLE_GRID + cell.y()) * SAMPLE_GRID + cell.x();
+        if (!taken[key]) {
+            taken[key] = true;
+            std::swap(order[i], order[middle++]);
+        }
+    }
+    octree.nodes[index].end = middle;
+
+    // counting sort of remaining points by octant
+    std::vector<unsigned char> octants(end - middle);
+    size_t counts[8] = {0};
+    for (size_t i = middle; i < end; i++) {
+        const Eigen::Vector3f &p = cloud.points[order[i]].getVector3fMap();
+        const unsigned char octant = (p.x() >= center.x() ? 1 : 0) | (p.y() >= center.y() ? 2 : 0) | (p.z() >= center.z() ? 4 : 0);
+        octants[i - middle] = octant;
+        counts[octant]++;
+    }
+    size_t offsets[9];
+    offsets[0] = middle;
+    for (int o = 0; o < 8; o++) {
+        offsets[o + 1] = offsets[o] + counts[o];
+    }
+    std::vector<int> rest(order.begin() + middle, order.begin() + end);
+    size_t cursor[8];
+    std::copy(offsets, offsets + 8, cursor);
+    for (size_t i = 0; i < rest.size(); i++) {
+        order[cursor[octants[i]]++] = rest[i];
+    }
+
+    for (int o = 0; o < 8; o++) {
+        if (counts[o] == 0) {
+            continue;
+        }
+        node child;
+        child.half = half / 2;
+        child.center = center + Eigen::Vector3f((o & 1) ? child.half : -child.half,
+                                                (o & 2) ? child.half : -child.half,
+                                                (o & 4) ? child.half : -child.half);
+        octree.nodes.push_back(child);
+        octree.nodes[index].children[o] = octree.nodes.size() - 1;
+        split(octree, octree.nodes.size() - 1, offsets[o], offsets[o + 1], depth + 1);
+    }
+}
+
+/** \brief Selects points of visible nodes, nodes biggest on screen first
+  * \param octree input octree
+  * \param camera camera of viewer
+  * \param budget most points selected
+  * \param pixelSpacing children of nodes with samples closer on screen are skipped
+  * \param result resultant points
+  * \return true if all points were selected
+  */
+bool lod::select(const tree &octree, const view &camera, size_t budget, float pixelSpacing, PointCloudT &result) {
+    result.points.clear();
+    bool complete = true;
+    std::priority_queue<std::pair<float, int> > queue;
+    if (!octree.nodes.empty()) {
+        queue.push(std::make_pair(spacing(octree.nodes[0], camera), 0));
+    }
+    while (!queue.empty()) {
+        const node &n = octree.nodes[queue.top().second];
+        const float projected = queue.top().first;
+        queue.pop();
+        if (!visible(n, camera)) {
+            complete = false;
+            continue;
+        }
+        if (result.points.size() + (n.end - n.begin) > budget) {
+            complete = false;
+            break;
+        }
+        for (int i = n.begin; i < n.end; i++) {
+            result.points.push_back(octree.cloud->points[octree.order[i]]);
+        }
+        for (int o = 0; o < 8; o++) {
+            if (n.children[o] < 0) {
+                continue;
+            }
+            if (projected < pixelSpacing) {
+                complete = false;
+                break;
+            }
+            queue.push(std::make_pair(spacing(octree.nodes[n.children[o]], camera), n.children[o]));
+        }
+    }
+    result.width = result.points.size();
+    result.height = 1;
+    result.is_dense = true;
+    if (octree.cloud) {
+        result.sensor_origin_ = octree.cloud->sensor_origin_;
+        result.sensor_orientation_ = octree.cloud->sensor_orientation_;
+    }
+    return complete;
+}
+
+/** \brief Converts camera of viewer for selection
+  * \param camera camera of viewer
+  */
+lod::view lod::fromCamera(const pcl::visualization::Camera &camera) {
+    view result;
+    result.position = Eigen::Vector3d(camera.pos[0], camera.pos[1], camera.pos[2]).cast<float>();
+    const Eigen::Vector3f focal = Eigen::Vector3d(camera.focal[0], camera.focal[1], camera.focal[2]).cast<float>();
+    result.forward = (focal - result.position).normalized();
+    result.right = result.forward.cross(Eigen::Vector3d(camera.view[0], camera.view[1], camera.view[2]).cast<float>()).normalized();
+    result.up = result.right.cross(result.forward);
+    const float height = std::max(camera.window_size[1], 1.0);
+    const float width = std::max(camera.window_size[0], 1.0);
+    result.tanY = std::tan(camera.fovy / 2);
+    result.tanX = result.tanY * width / height;
+    result.nearClip = std::max(camera.clip[0], 0.001);
+    result.pixels = height / (2 * result.tanY);
+    return result;
+}
@@ -0,0 +1,116 @@
+/*
+    This file is part of RoomScanner.
+
+    RoomScanner is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    RoomScanner is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with RoomScanner.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef LOD_H
+#define LOD_H
+
+#include "types.h"
+#include "parameters.h"
+#include <pcl/visualization/pcl_visualizer.h>
+#include <pcl/visualization/point_cloud_color_handlers.h>
+#include <boost/shared_ptr.hpp>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <map>
+
+// Level of detail layer of point cloud viewer. Displayed clouds are sorted
+// into an octree whose every node keeps a uniform sample of its cube, the
+// rest goes to children. Only nodes in view are rendered, the biggest on
+// screen first, until point budget is met or points get denser than pixels.
+// Budget is lowered while the camera moves and raised while it is idle.
+// Opacity, color override and point size are properties of the actor,
+// points of displayed clouds are never rewritten for display.
+class lod
+{
+public:
+    typedef boost::shared_ptr<lod> Ptr;
+
+    // render properties of cloud in viewer
+    struct style {
+        double opacity;
+        bool colored; // color below overrides colors of points
+        double r, g, b;
+        int pointSize;
+        style() : opacity(1.0), colored(false), r(1.0), g(1.0), b(1.0), pointSize(1) {}
+    };
+
+    // colors of points uploaded to viewer, black points would be lost on
+    // black background and are shown gray, point data stays untouched
+    class colorHandler : public pcl::visualization::PointCloudColorHandler<PointT> {
+    public:
+        colorHandler(const PointCloudT::ConstPtr &cloud);
+        virtual std::string getName() const { return "lod"; }
+        virtual std::string getFieldName() const { return "rgb"; }
+        virtual bool getColor(vtkSmartPointer<vtkDataArray> &scalars) const;
+    };
+
+    // octree node, own points are order[begin, end)
+    struct node {
+        Eigen::Vector3f center;
+        float half;
+        int begin, end;
+        int children[8];
+    };
+
+    struct tree {
+        PointCloudT::ConstPtr cloud;
+        std::vector<int> order;
+        std::vector<node> nodes;
+    };
+
+    // camera reduced to what selection needs
+    struct view {
+        Eigen::Vector3f position, forward, right, up;
+        float tanX, tanY;
+        float nearClip;
+        float pixels; // pixels per unit at unit distance
+    };
+
+    lod(const boost::shared_ptr<pcl::visualization::PCLVisualizer> &viewer);
+
+    void show(const PointCloudT::ConstPtr &cloud, const std::string &id);
+    void hide(const std::string &id);
+    void clear();
+    bool refresh();
+    void setStyle(const std::string &id, const style &look);
+    void applyStyle(const std::string &id);
+
+    static void build(const PointCloudT::ConstPtr &cloud, tree &result);
+    static bool select(const tree &octree, const view &camera, size_t budget, float pixelSpacing, PointCloudT &result);
+    static view fromCamera(const pcl::visualization::Camera &camera);
+
+private:
+    struct layer {
+        std::string id;
+        boost::shared_ptr<tree> octree;
+        std::vector<double> camera;
+        size_t budget;
+        bool complete;
+        bool changed;
+    };
+
+    static void split(tree &octree, int index, size_t begin, size_t end, int depth);
+    void apply(const std::string &id);
+
+    boost::shared_ptr<pcl::visualization::PCLVisualizer> viewer;
+    std::vector<layer> layers;
+    std::vector<std::string> removed;
+    std::map<std::string, style> styles;
+    std::mutex mutex;
+};
+
+#endif // LOD_H
@@ -16,11 +16,49 @@
 */
 
 #include "application.h"
+#include "sweep.h"
 #include <QApplication>
 #include <QMainWindow>
 
 int main (int argc, char *argv[])
 {
+    // gui and headless runs start from the same config file
+    loadParameters ("config.json");
+
+    // benchmarks on given pcd files, no gui
+    std::vector<int> fileIndices = pcl::console::parse_file_extension_argument (argc, argv, ".pcd");
+    std::vector<std::string> files;
+    for (size_t i = 0; i < fileIndices.size (); i++) {
+        files.push_back (argv[fileIndices[i]]);
+    }
+    if (pcl::console::find_switch (argc, argv, "--bench-keypoints")) {
+        return keypoints::benchmark (files);
+    }
+    if (pcl::console::find_switch (argc, argv, "--bench-outliers")) {
+        return filters::benchmarkOutliers (files, 0.8f);
+    }
+    if (pcl::console::find_switch (argc, argv, "--bench-voxel")) {
+        return filters::benchmarkVoxelGrid (files, 0.02f);
+    }
+    // reconstruction with every combination of --sweep name=value,value,... and fixed --set name=value
+    if (pcl::console::find_switch (argc, argv, "--sweep")) {
+        std::vector<std::string> grid, fixed;
+        for (int i = 1; i + 1 < argc; i++) {
+            if (std::string (argv[i]) == "--sweep") {
+                grid.push_back (argv[i + 1]);
+            }
+            else if (std::string (argv[i]) == "--set") {
+                fixed.push_back (argv[i + 1]);
+            }
+        }
+        std::string mesher = "greedy";
+        float tolerance = 0.01f;
+        pcl::console::parse_argument (argc, argv, "--mesher", mesher);
+        pcl::console::parse_argument (argc, argv, "--tolerance", tolerance);
+        return sweep::run (files, grid, fixed, mesher, pcl::console::find_switch (argc, argv, "--holes"),
+                           pcl::console::find_switch (argc, argv, "--decimate"), tolerance);
+    }
+
     QApplication a (argc, argv);
     RoomScanner w;
     w.show ();
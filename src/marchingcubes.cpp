@@ -0,0 +1,277 @@
+/*
+    This file is part of RoomScanner.
+
+    RoomScanner is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    RoomScanner is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with RoomScanner.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "marchingcubes.h"
+#include <unordered_map>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+
+namespace {
+
+struct edgeKey {
+    int x, y, z, axis;
+    bool operator==(const edgeKey &other) const {
+        return x == other.x && y == other.y && z == other.z && axis == other.axis;
+    }
+};
+
+struct edgeKeyHash {
+    size_t operator()(const edgeKey &k) const {
+        return ((static_cast<size_t>(k.x) * 73856093u) ^ (static_cast<size_t>(k.y) * 19349663u) ^ (static_cast<size_t>(k.z) * 83492791u)) * 4 + k.axis;
+    }
+};
+
+// result of one block, vertices on block border carry their global edge
+struct blockResult {
+    PointCloudT vertices;
+    std::vector<edgeKey> border;
+    std::vector<uint32_t> indices;
+};
+
+inline int sampleIndex(int x, int y, int z) {
+    return (z * marchingcubes::SAMPLES + y) * marchingcubes::SAMPLES + x;
+}
+
+bool keyLess(const Eigen::Vector3i &a, const Eigen::Vector3i &b) {
+    if (a.x() != b.x()) return a.x() < b.x();
+    if (a.y() != b.y()) return a.y() < b.y();
+    return a.z() < b.z();
+}
+
+}
+
+/** \brief Extracts zero level set of block partitioned field
+  * \param sdf signed distance field
+  * \param triangles resultant indexed mesh
+  */
+void marchingcubes::extract(const field &sdf, trimesh &triangles) {
+    // corner offsets and edges in the order of pcl::edgeTable and pcl::triTable
+    static const int corners[8][3] = {{0,0,0}, {1,0,0}, {1,0,1}, {0,0,1}, {0,1,0}, {1,1,0}, {1,1,1}, {0,1,1}};
+    static const int edges[12][2] = {{0,1}, {1,2}, {2,3}, {3,0}, {4,5}, {5,6}, {6,7}, {7,4}, {0,4}, {1,5}, {2,6}, {3,7}};
+
+    std::vector<Eigen::Vector3i> keys;
+    sdf.blocks(keys);
+    const float voxel = sdf.voxelSize();
+    PCL_INFO("Marching cubes over %d blocks\n", keys.size());
+
+    std::vector<blockResult> results(keys.size());
+    const progress::Ptr job = progress::current();
+    int finished = 0;
+
+#pragma omp parallel
+    {
+        std::vector<float> values(SAMPLES * SAMPLES * SAMPLES);
+        std::vector<uint32_t> colors(SAMPLES * SAMPLES * SAMPLES);
+        std::vector<int> edgeVertex(SAMPLES * SAMPLES * SAMPLES * 3);
+
+#pragma omp for schedule(dynamic)
+        for (int b = 0; b < static_cast<int>(keys.size()); b++) {
+            // worker threads do not see current job, remaining blocks are skipped once cancelled
+            if (job && job->isCancelled()) {
+                continue;
+            }
+            const Eigen::Vector3i origin = keys[b] * BLOCK_SIZE;
+            blockResult &result = results[b];
+            sdf.sample(keys[b], &values[0], &colors[0]);
+            std::fill(edgeVertex.begin(), edgeVertex.end(), -1);
+
+            for (int lz = 0; lz < BLOCK_SIZE; lz++) {
+                for (int ly = 0; ly < BLOCK_SIZE; ly++) {
+                    for (int lx = 0; lx < BLOCK_SIZE; lx++) {
+                        float cube[8];
+                        int cubeIndex = 0;
+                        bool valid = true;
+                        for (int i = 0; i < 8 && valid; i++) {
+                            cube[i] = values[sampleIndex(lx + corners[i][0], ly + corners[i][1], lz + corners[i][2])];
+                            valid = std::isfinite(cube[i]);
+                            if (cube[i] < 0.0f) {
+                                cubeIndex |= 1 << i;
+                            }
+                        }
+                        if (!valid || pcl::edgeTable[cubeIndex] == 0) {
+                            continue;
+                        }
+
+                        int vertexList[12];
+                        for (int e = 0; e < 12; e++) {
+                            if (!(pcl::edgeTable[cubeIndex] & (1 << e))) {
+                                continue;
+                            }
+                            const int a = edges[e][0], c = edges[e][1];
+                            int axis = 0;
+                            while (corners[a][axis] == corners[c][axis]) {
+                                axis++;
+                            }
+                            const int low = (corners[a][axis] < corners[c][axis]) ? a : c;
+                            const int high = (low == a) ? c : a;
+                            const int l[3] = {lx + corners[low][0], ly + corners[low][1], lz + corners[low][2]};
+                            int &slot = edgeVertex[sampleIndex(l[0], l[1], l[2]) * 3 + axis];
+
+                            if (slot < 0) {
+                                const float t = cube[low] / (cube[low] - cube[high]);
+                                PointT p;
+                                p.x = (origin.x() + l[0]) * voxel;
+                                p.y = (origin.y() + l[1]) * voxel;
+                                p.z = (origin.z() + l[2]) * voxel;
+                                (&p.x)[axis] += t * voxel;
+                                const int h[3] = {lx + corners[high][0], ly + corners[high][1], lz + corners[high][2]};
+                                p.rgba = (t < 0.5f) ? colors[sampleIndex(l[0], l[1], l[2])] : colors[sampleIndex(h[0], h[1], h[2])];
+
+                                // edge on block face may be created by neighbor block too
+                                bool border = false;
+                                for (int d = 0; d < 3; d++) {
+                                    if (d != axis && (l[d] == 0 || l[d] == BLOCK_SIZE)) {
+                                        border = true;
+                                    }
+                                }
+                                edgeKey key = {origin.x() + l[0], origin.y() + l[1], origin.z() + l[2], border ? axis : -1};
+                                slot = result.vertices.points.size();
+                                result.vertices.points.push_back(p);
+                                result.border.push_back(key);
+                            }
+                            vertexList[e] = slot;
+                        }
+
+                        for (int i = 0; pcl::triTable[cubeIndex][i] != -1; i++) {
+                            result.indices.push_back(vertexList[pcl::triTable[cubeIndex][i]]);
+                        }
+                    }
+                }
+            }
+
+            int done;
+#pragma omp atomic capture
+            done = ++finished;
+            if (job) {
+                job->report(done / static_cast<double>(keys.size()), "Marching cubes");
+            }
+        }
+    }
+    progress::check();
+
+    // merge blocks, deduplicate vertices shared by neighbor blocks
+    std::unordered_map<edgeKey, uint32_t, edgeKeyHash> borderVertex;
+    triangles.clear();
+
+    for (size_t b = 0; b < results.size(); b++) {
+        blockResult &result = results[b];
+        std::vector<uint32_t> remap(result.vertices.points.size());
+        for (size_t v = 0; v < result.vertices.points.size(); v++) {
+            if (result.border[v].axis < 0) {
+                remap[v] = triangles.addVertex(result.vertices.points[v]);
+                continue;
+            }
+            std::pair<std::unordered_map<edgeKey, uint32_t, edgeKeyHash>::iterator, bool> inserted =
+                    borderVertex.insert(std::make_pair(result.border[v], static_cast<uint32_t>(triangles.vertexCount())));
+            if (inserted.second) {
+                triangles.addVertex(result.vertices.points[v]);
+            }
+            remap[v] = inserted.first->second;
+        }
+        for (size_t i = 0; i + 2 < result.indices.size(); i += 3) {
+            triangles.addTriangle(remap[result.indices[i]], remap[result.indices[i + 1]], remap[result.indices[i + 2]]);
+        }
+        result = blockResult();
+    }
+
+    PCL_INFO("Marching cubes created %d vertices and %d triangles\n", triangles.vertexCount(), triangles.triangleCount());
+}
+
+/** \brief Creates field from oriented points
+  * \param cloud input cloud with normals
+  * \param voxelSize grid resolution
+  * \param distIgnore grid points further from cloud are unknown
+  */
+marchingcubes::hoppeField::hoppeField(const PointCloudRGBNT::Ptr &cloud, float voxelSize, float distIgnore) {
+    this->cloud = cloud;
+    this->size = voxelSize;
+    this->distIgnore = distIgnore;
+    tree.setInputCloud(cloud);
+}
+
+/** \brief Lists blocks in reach of input points
+  * \param keys resultant block coordinates
+  */
+void marchingcubes::hoppeField::blocks(std::vector<Eigen::Vector3i> &keys) const {
+    const float blockSide = size * BLOCK_SIZE;
+    keys.clear();
+
+#pragma omp parallel
+    {
+        std::vector<Eigen::Vector3i> local;
+#pragma omp for nowait
+        for (int i = 0; i < static_cast<int>(cloud->points.size()); i++) {
+            const NormalRGBT &p = cloud->points[i];
+            if (!std::isfinite(p.x) || !std::isfinite(p.y) || !std::isfinite(p.z)) {
+                continue;
+            }
+            Eigen::Vector3i low(static_cast<int>(std::floor((p.x - distIgnore) / blockSide)),
+                                static_cast<int>(std::floor((p.y - distIgnore) / blockSide)),
+                                static_cast<int>(std::floor((p.z - distIgnore) / blockSide)));
+            Eigen::Vector3i high(static_cast<int>(std::floor((p.x + distIgnore) / blockSide)),
+                                 static_cast<int>(std::floor((p.y + distIgnore) / blockSide)),
+                                 static_cast<int>(std::floor((p.z + distIgnore) / blockSide)));
+            for (int z = low.z(); z <= high.z(); z++) {
+                for (int y = low.y(); y <= high.y(); y++) {
+                    for (int x = low.x(); x <= high.x(); x++) {
+                        local.push_back(Eigen::Vector3i(x, y, z));
+                    }
+                }
+            }
+            if (local.size() > 65536) {
+                std::sort(local.begin(), local.end(), keyLess);
+                local.erase(std::unique(local.begin(), local.end()), local.end());
+            }
+        }
+#pragma omp critical
+        keys.insert(keys.end(), local.begin(), local.end());
+    }
+    std::sort(keys.begin(), keys.end(), keyLess);
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+}
+
+/** \brief Samples distance to tangent plane of nearest point
+  * \param key block coordinates
+  * \param values resultant signed distances
+  * \param colors resultant colors of nearest points
+  */
+void marchingcubes::hoppeField::sample(const Eigen::Vector3i &key, float *values, uint32_t *colors) const {
+    std::vector<int> index(1);
+    std::vector<float> sqrDist(1);
+    const float nan = std::numeric_limits<float>::quiet_NaN();
+    NormalRGBT query;
+
+    for (int z = 0; z < SAMPLES; z++) {
+        for (int y = 0; y < SAMPLES; y++) {
+            for (int x = 0; x < SAMPLES; x++) {
+                const int i = sampleIndex(x, y, z);
+                query.x = (key.x() * BLOCK_SIZE + x) * size;
+                query.y = (key.y() * BLOCK_SIZE + y) * size;
+                query.z = (key.z() * BLOCK_SIZE + z) * size;
+                if (tree.nearestKSearch(query, 1, index, sqrDist) < 1 || sqrDist[0] > distIgnore * distIgnore) {
+                    values[i] = nan;
+                    colors[i] = 0;
+                    continue;
+                }
+                const NormalRGBT &p = cloud->points[index[0]];
+                values[i] = p.normal_x * (query.x - p.x) + p.normal_y * (query.y - p.y) + p.normal_z * (query.z - p.z);
+                colors[i] = p.rgba;
+            }
+        }
+    }
+}
@@ -0,0 +1,69 @@
+/*
+    This file is part of RoomScanner.
+
+    RoomScanner is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    RoomScanner is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with RoomScanner.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef MARCHINGCUBES_H
+#define MARCHINGCUBES_H
+
+#include "types.h"
+#include "parameters.h"
+#include "progress.h"
+#include "trimesh.h"
+#include <pcl/surface/marching_cubes.h>
+#include <pcl/search/kdtree.h>
+#include <vector>
+
+// Marching cubes over signed distance field partitioned to blocks.
+// Blocks are processed in parallel, vertices on block borders are shared.
+class marchingcubes
+{
+public:
+    // cubes per block side
+    static const int BLOCK_SIZE = 8;
+    // samples per block side, including border shared with neighbor block
+    static const int SAMPLES = BLOCK_SIZE + 1;
+
+    // Signed distance field, negative inside, positive outside
+    class field
+    {
+    public:
+        virtual ~field() {}
+        virtual float voxelSize() const = 0;
+        virtual void blocks(std::vector<Eigen::Vector3i> &keys) const = 0;
+        // fills SAMPLES^3 values (x fastest) of block, NaN if unknown
+        virtual void sample(const Eigen::Vector3i &key, float *values, uint32_t *colors) const = 0;
+    };
+
+    // Hoppe distance to tangent plane of nearest point
+    class hoppeField : public field
+    {
+    public:
+        hoppeField(const PointCloudRGBNT::Ptr &cloud, float voxelSize, float distIgnore);
+        float voxelSize() const { return size; }
+        void blocks(std::vector<Eigen::Vector3i> &keys) const;
+        void sample(const Eigen::Vector3i &key, float *values, uint32_t *colors) const;
+
+    private:
+        PointCloudRGBNT::Ptr cloud;
+        pcl::search::KdTree<NormalRGBT> tree;
+        float size;
+        float distIgnore;
+    };
+
+    static void extract(const field &sdf, trimesh &triangles);
+};
+
+#endif // MARCHINGCUBES_H
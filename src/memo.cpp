@@ -0,0 +1,548 @@
+/*
+    This file is part of RoomScanner.
+
+    RoomScanner is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    RoomScanner is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with RoomScanner.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "memo.h"
+#include <pcl/common/time.h>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+std::mutex memo::memoMutex;
+std::condition_variable memo::finished;
+std::list<memo::entry> memo::entries;
+std::set<uint64_t> memo::running;
+size_t memo::resident = 0;
+size_t memo::generation = 0;
+size_t memo::hits = 0;
+size_t memo::misses = 0;
+
+namespace {
+
+const uint64_t FNV_OFFSET = 14695981039346656037ull;
+const uint64_t FNV_PRIME = 1099511628211ull;
+
+// FNV-1a over bytes
+uint64_t hashBytes(uint64_t hash, const unsigned char *bytes, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        hash = (hash ^ bytes[i]) * FNV_PRIME;
+    }
+    return hash;
+}
+
+inline uint64_t hashValue(uint64_t hash, uint64_t value) {
+    return (hash ^ value) * FNV_PRIME;
+}
+
+// blocks are hashed in parallel and combined in order
+uint64_t hashBuffer(const unsigned char *data, size_t count) {
+    const size_t blockSize = 1 << 20;
+    const int blocks = (count + blockSize - 1) / blockSize;
+    std::vector<uint64_t> blockHashes(blocks);
+#pragma omp parallel for
+    for (int b = 0; b < blocks; b++) {
+        const size_t begin = b * blockSize;
+        blockHashes[b] = hashBytes(FNV_OFFSET, data + begin, std::min(blockSize, count - begin));
+    }
+    uint64_t hash = hashValue(FNV_OFFSET, count);
+    for (int b = 0; b < blocks; b++) {
+        hash = hashValue(hash, blockHashes[b]);
+    }
+    return hash;
+}
+
+template <typename T>
+void writeValue(std::ostream &file, const T &value) {
+    file.write(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+template <typename T>
+void readValue(std::istream &file, T &value) {
+    file.read(reinterpret_cast<char *>(&value), sizeof(T));
+}
+
+// points of input cloud hashed per block, block hashes are combined in order
+const size_t HASH_BLOCK_POINTS = 1 << 16;
+
+void writeCloud(std::ostream &file, const PointCloudT &cloud) {
+    const uint64_t count = cloud.points.size();
+    writeValue(file, cloud.width);
+    writeValue(file, cloud.height);
+    writeValue(file, cloud.is_dense);
+    writeValue(file, cloud.sensor_origin_);
+    writeValue(file, cloud.sensor_orientation_.coeffs());
+    writeValue(file, count);
+    file.write(reinterpret_cast<const char *>(cloud.points.data()), count * sizeof(PointT));
+}
+
+// false if file is short or does not hold expected number of bytes
+bool readCloud(std::istream &file, PointCloudT &cloud, size_t bytes) {
+    uint64_t count = 0;
+    readValue(file, cloud.width);
+    readValue(file, cloud.height);
+    readValue(file, cloud.is_dense);
+    readValue(file, cloud.sensor_origin_);
+    Eigen::Vector4f orientation;
+    readValue(file, orientation);
+    cloud.sensor_orientation_.coeffs() = orientation;
+    readValue(file, count);
+    if (!file || count * sizeof(PointT) != bytes) {
+        return false;
+    }
+    cloud.points.resize(count);
+    file.read(reinterpret_cast<char *>(cloud.points.data()), count * sizeof(PointT));
+    return static_cast<bool>(file);
+}
+
+template <typename T>
+void writeVector(std::ostream &file, const std::vector<T> &values) {
+    writeValue(file, static_cast<uint64_t>(values.size()));
+    file.write(reinterpret_cast<const char *>(values.data()), values.size() * sizeof(T));
+}
+
+// false if file is short or vector would exceed remaining bytes
+template <typename T>
+bool readVector(std::istream &file, std::vector<T> &values, size_t &bytes) {
+    uint64_t count = 0;
+    readValue(file, count);
+    if (!file || count > bytes / sizeof(T)) {
+        return false;
+    }
+    bytes -= count * sizeof(T);
+    values.resize(count);
+    file.read(reinterpret_cast<char *>(values.data()), count * sizeof(T));
+    return static_cast<bool>(file);
+}
+
+void writeMesh(std::ostream &file, const trimesh &mesh) {
+    writeVector(file, mesh.positions);
+    writeVector(file, mesh.colors);
+    writeVector(file, mesh.indices);
+}
+
+bool readMesh(std::istream &file, trimesh &mesh, size_t bytes) {
+    return readVector(file, mesh.positions, bytes) && readVector(file, mesh.colors, bytes) &&
+           readVector(file, mesh.indices, bytes) && bytes == 0;
+}
+
+}
+
+/** \brief Wraps input cloud of pipeline, its key is hash of coordinates, colors and organization
+  * \param cloud input cloud
+  * \return cloud with its key
+  */
+memo::cloudResult memo::input(const PointCloudT::Ptr &cloud) {
+    // padding of points is skipped, each block is packed to small buffer of its thread
+    const size_t size = cloud->points.size();
+    const int blocks = (size + HASH_BLOCK_POINTS - 1) / HASH_BLOCK_POINTS;
+    std::vector<uint64_t> blockHashes(blocks);
+#pragma omp parallel
+    {
+        std::vector<uint32_t> values(4 * HASH_BLOCK_POINTS);
+#pragma omp for
+        for (int b = 0; b < blocks; b++) {
+            const size_t begin = b * HASH_BLOCK_POINTS;
+            const size_t count = std::min(HASH_BLOCK_POINTS, size - begin);
+            for (size_t i = 0; i < count; i++) {
+                const PointT &p = cloud->points[begin + i];
+                std::memcpy(&values[4 * i], p.data, 3 * sizeof(uint32_t));
+                values[4 * i + 3] = p.rgba;
+            }
+            blockHashes[b] = hashBytes(FNV_OFFSET, reinterpret_cast<const unsigned char *>(values.data()), 4 * count * sizeof(uint32_t));
+        }
+    }
+    uint64_t hash = hashValue(FNV_OFFSET, 4 * size * sizeof(uint32_t));
+    for (int b = 0; b < blocks; b++) {
+        hash = hashValue(hash, blockHashes[b]);
+    }
+    cloudResult result;
+    result.cloud = cloud;
+    result.key = hashValue(hashValue(hash, cloud->width), cloud->height);
+    return result;
+}
+
+/** \brief Wraps mesh produced outside of memoized stages, its key is hash of vertices and polygons
+  * \param mesh input mesh
+  * \return mesh with its key
+  */
+memo::meshResult memo::input(const trimesh::Ptr &mesh) {
+    uint64_t hash = hashBuffer(reinterpret_cast<const unsigned char *>(mesh->positions.data()), mesh->positions.size() * sizeof(float));
+    hash = hashValue(hash, hashBuffer(reinterpret_cast<const unsigned char *>(mesh->colors.data()), mesh->colors.size() * sizeof(uint32_t)));
+    hash = hashValue(hash, hashBuffer(reinterpret_cast<const unsigned char *>(mesh->indices.data()), mesh->indices.size() * sizeof(uint32_t)));
+    meshResult result;
+    result.mesh = mesh;
+    result.key = hash;
+    return result;
+}
+
+/** \brief Runs cloud stage unless result for same input and parameters is known
+  * \param stage name of stage, parameters are found by its first word
+  * \param function stage taking input and output cloud
+  * \param input input cloud with its key
+  * \return shared output cloud with its key, must not be modified
+  */
+memo::cloudResult memo::cloud(const std::string &stage, const cloudStage &function, const cloudResult &input) {
+    cloudResult result;
+    result.key = stageKey(input.key, stage);
+    entry cached;
+    if (find(result.key, cached)) {
+        PCL_INFO("Stage %s taken from memo (%d hits, %d misses)\n", stage.c_str(), hits, misses);
+        result.cloud = cached.cloud;
+        return result;
+    }
+    pcl::console::TicToc tt;
+    tt.tic();
+    result.cloud.reset(new PointCloudT);
+    try {
+        function(input.cloud, result.cloud);
+    }
+    catch (...) {
+        entry failed = {result.key, PointCloudT::Ptr(), trimesh::Ptr(), 0, false};
+        store(failed);
+        throw;
+    }
+    PCL_INFO("Stage %s computed in %g ms\n", stage.c_str(), tt.toc());
+    entry computed = {result.key, result.cloud, trimesh::Ptr(), result.cloud->points.size() * sizeof(PointT), false};
+    store(computed);
+    return result;
+}
+
+/** \brief Runs surface reconstruction unless result for same input and parameters is known
+  * \param stage name of stage, parameters are found by its first word
+  * \param function mesher taking input cloud and output mesh
+  * \param input input cloud with its key
+  * \return shared mesh with its key, must not be modified
+  */
+memo::meshResult memo::mesh(const std::string &stage, const meshStage &function, const cloudResult &input) {
+    meshResult result;
+    result.key = stageKey(input.key, stage);
+    entry cached;
+    if (find(result.key, cached)) {
+        PCL_INFO("Stage %s taken from memo (%d hits, %d misses)\n", stage.c_str(), hits, misses);
+        result.mesh = cached.mesh;
+        return result;
+    }
+    pcl::console::TicToc tt;
+    tt.tic();
+    result.mesh.reset(new trimesh);
+    try {
+        function(input.cloud, result.mesh);
+    }
+    catch (...) {
+        entry failed = {result.key, PointCloudT::Ptr(), trimesh::Ptr(), 0, false};
+        store(failed);
+        throw;
+    }
+    PCL_INFO("Stage %s computed in %g ms\n", stage.c_str(), tt.toc());
+    entry computed = {result.key, PointCloudT::Ptr(), result.mesh, result.mesh->bytes(), false};
+    store(computed);
+    return result;
+}
+
+/** \brief Runs mesh post-processing unless result for same input and parameters is known
+  * \param stage name of stage, parameters are found by its first word
+  * \param function stage taking input and output mesh
+  * \param input input mesh with its key
+  * \return shared mesh with its key, must not be modified
+  */
+memo::meshResult memo::post(const std::string &stage, const postStage &function, const meshResult &input) {
+    meshResult result;
+    result.key = stageKey(input.key, stage);
+    entry cached;
+    if (find(result.key, cached)) {
+        PCL_INFO("Stage %s taken from memo (%d hits, %d misses)\n", stage.c_str(), hits, misses);
+        result.mesh = cached.mesh;
+        return result;
+    }
+    pcl::console::TicToc tt;
+    tt.tic();
+    result.mesh.reset(new trimesh);
+    try {
+        function(input.mesh, result.mesh);
+    }
+    catch (...) {
+        entry failed = {result.key, PointCloudT::Ptr(), trimesh::Ptr(), 0, false};
+        store(failed);
+        throw;
+    }
+    PCL_INFO("Stage %s computed in %g ms\n", stage.c_str(), tt.toc());
+    entry computed = {result.key, PointCloudT::Ptr(), result.mesh, result.mesh->bytes(), false};
+    store(computed);
+    return result;
+}
+
+/** \brief Lists values of all parameters read by stage
+  * \param stage name of stage, only its first word is used
+  * \return parameter values as text
+  */
+std::string memo::signature(const std::string &stage) {
+    parameters* params = parameters::GetInstance();
+    const std::string name = stage.substr(0, stage.find(' '));
+    std::ostringstream ss;
+    ss.precision(17);
+    // meshers share normals of the cache, organized clouds use integral images
+    if (name == "greedy" || name == "grid" || name == "mc" || name == "poisson") {
+        ss << params->NORintegral << ' ' << params->NORsmoothing << ' ' << params->NORmaxDepthChange << ';';
+    }
+    if (name == "fbf") {
+        ss << params->FBFsigmaS << ' ' << params->FBFsigmaR;
+    }
+    else if (stage == "voxel") {
+        // leaf is given in name of stage unless parameter is used
+        ss << params->VGFleafSize;
+    }
+    else if (name == "greedy") {
+        ss << params->GPsearchRadius << ' ' << params->GPmu << ' ' << params->GPmaximumNearestNeighbors;
+    }
+    else if (name == "grid") {
+        ss << params->GRres;
+    }
+    else if (name == "mc") {
+        ss << params->MCresolution << ' ' << params->MCdistIgnore;
+    }
+    else if (name == "poisson") {
+        ss << params->POSdepth;
+    }
+    else if (name == "tsdf") {
+        ss << params->TSDFvoxelSize << ' ' << params->TSDFtruncation << ' ' << params->TSDFmaxWeight << ' '
+           << params->TSDFmaxDepth << ' ' << params->TSDFfocal;
+    }
+    else if (name == "holes" || name == "decimation" || name == "holes+decimation") {
+        // post-processing filters run in one pipeline, only enabled ones are read
+        if (name != "decimation") {
+            ss << params->HOLsize << ' ';
+        }
+        if (name != "holes") {
+            ss << params->DECtargetReductionFactor;
+        }
+    }
+    return ss.str();
+}
+
+/** \brief Extends key by content of buffer, containers outside of memo key their content with it
+  * \param key key to extend
+  * \param data buffer
+  * \param bytes size of buffer
+  * \return new key
+  */
+uint64_t memo::hash(uint64_t key, const void *data, size_t bytes) {
+    return hashValue(key, hashBuffer(static_cast<const unsigned char *>(data), bytes));
+}
+
+/** \brief Drops all results and their spill files
+  */
+void memo::clear() {
+    std::lock_guard<std::mutex> lock(memoMutex);
+    for (std::list<entry>::iterator it = entries.begin(); it != entries.end(); ++it) {
+        if (it->spilled) {
+            std::remove(spillPath(it->key).c_str());
+        }
+    }
+    entries.clear();
+    resident = 0;
+    // results being spilled right now are dropped once written
+    generation++;
+}
+
+/** \brief Key of stage output
+  * \param input key of stage input
+  * \param stage name of stage
+  * \return hash of input key, stage name and parameter values
+  */
+uint64_t memo::stageKey(uint64_t input, const std::string &stage) {
+    const std::string text = stage + '|' + signature(stage);
+    return hashBytes(hashValue(FNV_OFFSET, input), reinterpret_cast<const unsigned char *>(text.data()), text.size());
+}
+
+/** \brief Looks up result, waits if another thread computes, loads or spills it, otherwise marks it as running.
+  * Spilled result is loaded and evicted results are written outside of lock, failed load counts as miss
+  * \param key key of result
+  * \param result found entry
+  * \return true if found, caller has to compute and store result otherwise
+  */
+bool memo::find(uint64_t key, entry &result) {
+    parameters* params = parameters::GetInstance();
+    if (params->MEMObudget <= 0) {
+        return false;
+    }
+    std::vector<entry> spills;
+    std::unique_lock<std::mutex> lock(memoMutex);
+    while (running.count(key) > 0) {
+        finished.wait(lock);
+    }
+    for (std::list<entry>::iterator it = entries.begin(); it != entries.end(); ++it) {
+        if (it->key == key) {
+            if (it->spilled) {
+                // others wait for key as if it was computed
+                entry spilled = *it;
+                entries.erase(it);
+                running.insert(key);
+                lock.unlock();
+                const bool loaded = load(spilled);
+                lock.lock();
+                if (!loaded) {
+                    misses++;
+                    return false;
+                }
+                running.erase(key);
+                entries.push_front(spilled);
+                resident += spilled.bytes;
+                result = spilled;
+                hits++;
+                evict(spills);
+                finished.notify_all();
+                const size_t started = generation;
+                lock.unlock();
+                spill(spills, started);
+                return true;
+            }
+            entries.splice(entries.begin(), entries, it);
+            result = entries.front();
+            hits++;
+            evict(spills);
+            const size_t started = generation;
+            lock.unlock();
+            spill(spills, started);
+            return true;
+        }
+    }
+    running.insert(key);
+    misses++;
+    return false;
+}
+
+/** \brief Reads spilled result back and removes its file
+  * \param result spilled entry, its empty cloud or mesh is filled
+  * \return true if whole result was read
+  */
+bool memo::load(entry &result) {
+    const std::string path = spillPath(result.key);
+    std::ifstream file(path.c_str(), std::ios::binary);
+    bool loaded;
+    if (result.cloud) {
+        loaded = readCloud(file, *result.cloud, result.bytes);
+    }
+    else {
+        loaded = readMesh(file, *result.mesh, result.bytes);
+    }
+    file.close();
+    std::remove(path.c_str());
+    if (!loaded) {
+        PCL_ERROR("Can not read spilled result %s, it is computed again\n", path.c_str());
+        return false;
+    }
+    result.spilled = false;
+    return true;
+}
+
+/** \brief Stores computed result and wakes threads waiting for it, empty result is not stored
+  * \param result entry to store
+  */
+void memo::store(const entry &result) {
+    parameters* params = parameters::GetInstance();
+    if (params->MEMObudget <= 0) {
+        return;
+    }
+    std::vector<entry> spills;
+    std::unique_lock<std::mutex> lock(memoMutex);
+    running.erase(result.key);
+    if (result.cloud || result.mesh) {
+        entries.push_front(result);
+        resident += result.bytes;
+        evict(spills);
+    }
+    finished.notify_all();
+    const size_t started = generation;
+    lock.unlock();
+    spill(spills, started);
+}
+
+/** \brief Drops least recently used results until resident ones fit memory budget, results to be spilled
+  * are taken out and marked as running so lookups wait until they are written, called under lock
+  * \param spills resultant results which caller writes by spill after unlocking
+  */
+void memo::evict(std::vector<entry> &spills) {
+    parameters* params = parameters::GetInstance();
+    const size_t budget = params->MEMObudget * 1024 * 1024;
+    std::list<entry>::iterator it = entries.end();
+    while (resident > budget && it != entries.begin()) {
+        --it;
+        if (it->spilled) {
+            continue;
+        }
+        resident -= it->bytes;
+        if (params->MEMOspill) {
+            running.insert(it->key);
+            spills.push_back(*it);
+        }
+        it = entries.erase(it);
+    }
+}
+
+/** \brief Writes evicted results to spill files outside of lock, written ones are put back as spilled
+  * with empty cloud or mesh to be filled again, failed ones are dropped
+  * \param spills results taken out by evict
+  * \param started generation of memo when results were taken out, cleared memo drops them
+  */
+void memo::spill(std::vector<entry> &spills, size_t started) {
+    if (spills.empty()) {
+        return;
+    }
+    std::vector<bool> written(spills.size());
+    for (size_t i = 0; i < spills.size(); i++) {
+        entry &victim = spills[i];
+        std::ofstream file(spillPath(victim.key).c_str(), std::ios::binary | std::ios::trunc);
+        // results still used by callers stay intact, spilled copy is read into new object
+        if (victim.cloud) {
+            writeCloud(file, *victim.cloud);
+            victim.cloud.reset(new PointCloudT);
+        }
+        else {
+            writeMesh(file, *victim.mesh);
+            victim.mesh.reset(new trimesh);
+        }
+        file.close();
+        written[i] = static_cast<bool>(file);
+        if (!written[i]) {
+            PCL_ERROR("Can not spill result to %s, it is dropped\n", spillPath(victim.key).c_str());
+        }
+        victim.spilled = true;
+    }
+
+    std::lock_guard<std::mutex> lock(memoMutex);
+    for (size_t i = 0; i < spills.size(); i++) {
+        running.erase(spills[i].key);
+        if (written[i] && generation == started) {
+            // least recently used end, like before eviction
+            entries.push_back(spills[i]);
+        }
+        else {
+            std::remove(spillPath(spills[i].key).c_str());
+        }
+    }
+    finished.notify_all();
+}
+
+/** \brief Name of spill file of result
+  * \param key key of result
+  */
+std::string memo::spillPath(uint64_t key) {
+    parameters* params = parameters::GetInstance();
+    std::ostringstream ss;
+    ss << params->MEMOpath << '_' << std::hex << key << ".bin";
+    return ss.str();
+}
@@ -0,0 +1,90 @@
+/*
+    This file is part of RoomScanner.
+
+    RoomScanner is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    RoomScanner is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with RoomScanner.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef MEMO_H
+#define MEMO_H
+
+#include "types.h"
+#include "parameters.h"
+#include "trimesh.h"
+#include <boost/function.hpp>
+#include <condition_variable>
+#include <mutex>
+#include <list>
+#include <set>
+#include <vector>
+#include <string>
+#include <cstdint>
+
+// Outputs of reconstruction stages keyed by content of their input and by the
+// parameters each stage reads, so only stages downstream of a changed parameter
+// run again. Results are shared and must not be modified. Least recently used
+// results are dropped or spilled to disk when memory budget is exceeded.
+class memo
+{
+public:
+    typedef boost::function<void (PointCloudT::Ptr, PointCloudT::Ptr)> cloudStage;
+    typedef boost::function<void (PointCloudT::Ptr, trimesh::Ptr)> meshStage;
+    typedef boost::function<void (trimesh::Ptr, trimesh::Ptr)> postStage;
+
+    // data with key of its content
+    struct cloudResult {
+        PointCloudT::Ptr cloud;
+        uint64_t key;
+    };
+
+    struct meshResult {
+        trimesh::Ptr mesh;
+        uint64_t key;
+    };
+
+    static cloudResult input(const PointCloudT::Ptr &cloud);
+    static meshResult input(const trimesh::Ptr &mesh);
+    static cloudResult cloud(const std::string &stage, const cloudStage &function, const cloudResult &input);
+    static meshResult mesh(const std::string &stage, const meshStage &function, const cloudResult &input);
+    static meshResult post(const std::string &stage, const postStage &function, const meshResult &input);
+
+    static std::string signature(const std::string &stage);
+    static uint64_t hash(uint64_t key, const void *data, size_t bytes);
+    static void clear();
+
+private:
+    struct entry {
+        uint64_t key;
+        PointCloudT::Ptr cloud;
+        trimesh::Ptr mesh;
+        size_t bytes;
+        bool spilled;
+    };
+
+    static uint64_t stageKey(uint64_t input, const std::string &stage);
+    static bool find(uint64_t key, entry &result);
+    static bool load(entry &result);
+    static void store(const entry &result);
+    static void evict(std::vector<entry> &spills);
+    static void spill(std::vector<entry> &spills, size_t started);
+    static std::string spillPath(uint64_t key);
+
+    static std::mutex memoMutex;
+    static std::condition_variable finished;
+    static std::list<entry> entries;
+    static std::set<uint64_t> running;
+    static size_t resident;
+    static size_t generation;
+    static size_t hits, misses;
+};
+
+#endif // MEMO_H
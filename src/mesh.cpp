@@ -26,19 +26,19 @@ mesh::mesh()
   * \param meshToSmooth pointer to input polygonmesh
   * \param output pointer to result
   */
-void mesh::smoothMesh(pcl::PolygonMesh::Ptr meshToSmooth, pcl::PolygonMesh::Ptr output) {
-    PCL_INFO("Smoothing mesh %d\n",meshToSmooth->polygons.size());
-    pcl::MeshSmoothingLaplacianVTK vtk;
-    vtk.setInputMesh(meshToSmooth);
-    vtk.setNumIter(20000);
-    vtk.setConvergence(0.1);
-    vtk.setRelaxationFactor(0.1);
-    vtk.setFeatureEdgeSmoothing(true);
-    vtk.setFeatureAngle(M_PI);
-    vtk.setBoundarySmoothing(true);
-    pcl::PolygonMesh::Ptr tmp (new pcl::PolygonMesh);
-    vtk.process(*tmp);
-    *output = *tmp;
+void mesh::smoothMesh(trimesh::Ptr meshToSmooth, trimesh::Ptr output) {
+    PCL_INFO("Smoothing mesh %d\n",meshToSmooth->triangleCount());
+    vtkSmartPointer<vtkSmoothPolyDataFilter> vtk = vtkSmartPointer<vtkSmoothPolyDataFilter>::New();
+    vtk->SetInputData(meshToSmooth->toPolyData());
+    vtk->SetNumberOfIterations(20000);
+    vtk->SetConvergence(0.1);
+    vtk->SetRelaxationFactor(0.1);
+    vtk->SetFeatureEdgeSmoothing(true);
+    vtk->SetFeatureAngle(M_PI);
+    vtk->SetBoundarySmoothing(true);
+    vtk->Update();
+    // input is converted already, output may be the input mesh
+    output->fromPolyData(vtk->GetOutput());
 }
 
 
@@ -46,26 +46,15 @@ void mesh::smoothMesh(pcl::PolygonMesh::Ptr meshToSmooth, pcl::PolygonMesh::Ptr
   * \param cloudToPolygonate pointer to input cloud
   * \param output pointer to resultant mesh
   */
-void mesh::polygonateCloudGreedyProj(PointCloudT::Ptr cloudToPolygonate, pcl::PolygonMesh::Ptr triangles) {
+void mesh::polygonateCloudGreedyProj(PointCloudT::Ptr cloudToPolygonate, trimesh::Ptr triangles) {
     PCL_INFO("Greedy polygonation\n");
     parameters* params = parameters::GetInstance();
 
     // Get Greedy result
-    // normal Estimation
-    pcl::NormalEstimation<PointT, pcl::Normal> normEstim;
-    pcl::PointCloud<pcl::Normal>::Ptr normals (new pcl::PointCloud<pcl::Normal>);
-    pcl::search::KdTree<PointT>::Ptr tree2 (new pcl::search::KdTree<PointT>);
-    //pcl::search::OrganizedNeighbor<PointT>::Ptr tree2 (new pcl::search::OrganizedNeighbor<PointT>); //only for organized cloud
-    tree2->setInputCloud(cloudToPolygonate);
-    normEstim.setInputCloud(cloudToPolygonate);
-    normEstim.setSearchMethod(tree2);
-    normEstim.setKSearch(20);
-    //normEstim.setNumberOfThreads(4);
-    normEstim.compute(*normals);
-
-    // concatenate the cloud with the normal fields
-    PointCloudRGBNT::Ptr cloud_normals (new PointCloudRGBNT);
-    pcl::concatenateFields(*cloudToPolygonate,*normals,*cloud_normals);
+    // normal Estimation, cloud concatenated with the normal fields
+    PointCloudRGBNT::Ptr cloud_normals = cache::withNormals(cloudToPolygonate, 20, 0.0f);
+    progress::update(0.3, "Greedy projection");
+    progress::check();
 
     pcl::search::KdTree<NormalRGBT>::Ptr tree_normal (new pcl::search::KdTree<NormalRGBT>);
     //pcl::search::OrganizedNeighbor<NormalRGBT>::Ptr tree_normal (new pcl::search::OrganizedNeighbor<pcl::PointXYZRGBNormal>); //only for organized cloud
@@ -84,51 +73,44 @@ void mesh::polygonateCloudGreedyProj(PointCloudT::Ptr cloudToPolygonate, pcl::Po
 
     gp.setInputCloud (cloud_normals);
     gp.setSearchMethod (tree_normal);
-    gp.reconstruct (*triangles);
-    PCL_INFO("Polygons created: %d\n", triangles->polygons.size());
+    pcl::PolygonMesh polygons;
+    gp.reconstruct (polygons);
+    progress::check();
+    triangles->fromPolygonMesh(polygons);
+    PCL_INFO("Polygons created: %d\n", triangles->triangleCount());
     //mesh::smoothMesh(triangles, triangles);
 }
 
 
-/** \brief Triangulation performed by marching cubes triangulation
+/** \brief Triangulation performed by block parallel marching cubes over Hoppe distance field
   * \param cloudToPolygonate pointer to input cloud
   * \param output pointer to resultant mesh
   */
-void mesh::polygonateCloudMC(PointCloudT::Ptr cloudToPolygonate, pcl::PolygonMesh::Ptr triangles) {
+void mesh::polygonateCloudMC(PointCloudT::Ptr cloudToPolygonate, trimesh::Ptr triangles) {
     PCL_INFO("Marching cubes\n");
-    pcl::NormalEstimationOMP<PointT, pcl::Normal> ne;
-    pcl::search::KdTree<PointT>::Ptr tree1 (new pcl::search::KdTree<PointT>);
-    tree1->setInputCloud (cloudToPolygonate);
-    ne.setInputCloud (cloudToPolygonate);
-    ne.setSearchMethod (tree1);
-    ne.setKSearch (20);
-    pcl::PointCloud<pcl::Normal>::Ptr normals (new pcl::PointCloud<pcl::Normal>);
-    ne.compute (*normals);
-
+    parameters* params = parameters::GetInstance();
     // concatenate the XYZ and normal fields*
-    PointCloudRGBNT::Ptr cloud_with_normals (new PointCloudRGBNT);
-    concatenateFields(*cloudToPolygonate, *normals, *cloud_with_normals);
+    PointCloudRGBNT::Ptr cloud_with_normals = cache::withNormals(cloudToPolygonate, 20, 0.0f);
 
-    pcl::search::KdTree<NormalRGBT>::Ptr tree (new pcl::search::KdTree<NormalRGBT>);
-    tree->setInputCloud (cloud_with_normals);
+    progress::update(0.3, "Marching cubes");
+    progress::check();
 
     PCL_INFO("begin marching cubes reconstruction\n");
 
-    pcl::MarchingCubesHoppe<NormalRGBT> mc;
-    //pcl::PolygonMesh::Ptr triangles(new pcl::PolygonMesh);
-    mc.setInputCloud (cloud_with_normals);
-    mc.setSearchMethod (tree);
-    mc.reconstruct (*triangles);
+    marchingcubes::hoppeField field(cloud_with_normals, params->MCresolution, params->MCdistIgnore);
+    {
+        progress::section extraction(0.3, 1.0);
+        marchingcubes::extract(field, *triangles);
+    }
 
-    PCL_INFO("%d triangles created\n", triangles->polygons.size());
-    //return triangles;
+    PCL_INFO("%d triangles created\n", triangles->triangleCount());
 }
 
 /** \brief Triangulation performed by poisson triangulation
   * \param cloudToPolygonate pointer to input cloud
   * \param output pointer to resultant mesh
   */
-void mesh::polygonateCloudPoisson(PointCloudT::Ptr cloudToPolygonate, pcl::PolygonMesh::Ptr triangles) {
+void mesh::polygonateCloudPoisson(PointCloudT::Ptr cloudToPolygonate, trimesh::Ptr triangles) {
     // Get Poisson result
     parameters* params = parameters::GetInstance();
 
@@ -137,16 +119,11 @@ void mesh::polygonateCloudPoisson(PointCloudT::Ptr cloudToPolygonate, pcl::Polyg
     filter.setInputCloud(cloudToPolygonate);
     filter.filter(*filtered);
 
-    pcl::NormalEstimationOMP<PointT, pcl::Normal> ne;
-    ne.setNumberOfThreads(8);
-    ne.setInputCloud(filtered);
-    ne.setRadiusSearch(0.01);
     Eigen::Vector4f centroid;
     pcl::compute3DCentroid(*filtered, centroid);
-    ne.setViewPoint(centroid[0], centroid[1], centroid[2]);
 
-    pcl::PointCloud<pcl::Normal>::Ptr cloud_normals (new pcl::PointCloud<pcl::Normal>());
-    ne.compute(*cloud_normals);
+    // cached normals are shared, flipped copy is needed
+    pcl::PointCloud<pcl::Normal>::Ptr cloud_normals (new pcl::PointCloud<pcl::Normal>(*cache::normals(filtered, 0, 0.01f, centroid.head<3>())));
 
     //reverse normal's direction
     for(size_t i = 0; i < cloud_normals->size(); ++i){
@@ -157,118 +134,131 @@ void mesh::polygonateCloudPoisson(PointCloudT::Ptr cloudToPolygonate, pcl::Polyg
 
     PointCloudRGBNT::Ptr cloud_smoothed_normals(new PointCloudRGBNT());
     concatenateFields(*filtered, *cloud_normals, *cloud_smoothed_normals);
+    progress::update(0.3, "Poisson");
+    progress::check();
 
     pcl::Poisson<NormalRGBT> poisson;
     poisson.setDepth(params->POSdepth);
     poisson.setInputCloud(cloud_smoothed_normals);
     poisson.setInputCloud(cloud_smoothed_normals);
-    poisson.reconstruct(*triangles);
-    PCL_INFO("mesh has %d triangles\n", triangles->polygons.size());
+    pcl::PolygonMesh polygons;
+    poisson.reconstruct(polygons);
+    progress::check();
+    triangles->fromPolygonMesh(polygons);
+    PCL_INFO("mesh has %d triangles\n", triangles->triangleCount());
 
 }
 
-/** \brief Fills holes in resultant mesh
-  * \param cloudToPolygonate pointer to input mesh
-  * \param output pointer to resultant mesh
+/** \brief Fills holes and decimates mesh in one vtk pipeline, input is converted once
+  * \param trianglesIn pointer to input mesh
+  * \param trianglesOut pointer to resultant mesh
+  * \param holes fills holes smaller than HOLsize
+  * \param decimation reduces triangles by DECtargetReductionFactor
+  * \param shown output of pipeline for viewer, set unless NULL
   */
-void mesh::fillHoles(pcl::PolygonMesh::Ptr trianglesIn, pcl::PolygonMesh::Ptr trianglesOut) {
+void mesh::postProcess(trimesh::Ptr trianglesIn, trimesh::Ptr trianglesOut, bool holes, bool decimation, vtkSmartPointer<vtkPolyData> *shown) {
     parameters* params = parameters::GetInstance();
-    vtkSmartPointer<vtkPolyData> input;
-    pcl::VTKUtils::mesh2vtk(*trianglesIn, input);
-
-    vtkSmartPointer<vtkFillHolesFilter> fillHolesFilter = vtkSmartPointer<vtkFillHolesFilter>::New();
-
-    fillHolesFilter->SetInputData(input);
-    fillHolesFilter->SetHoleSize(params->HOLsize);
-    fillHolesFilter->Update ();
+    const size_t before = trianglesIn->triangleCount();
+    vtkSmartPointer<vtkPolyData> input = trianglesIn->toPolyData();
+    // filters are connected by ports, data is passed between them without copies
+    vtkSmartPointer<vtkAlgorithm> last;
+
+    if (holes) {
+        vtkSmartPointer<vtkFillHolesFilter> fillHolesFilter = vtkSmartPointer<vtkFillHolesFilter>::New();
+        fillHolesFilter->SetInputData(input);
+        fillHolesFilter->SetHoleSize(params->HOLsize);
+        progress::observe(fillHolesFilter);
+        last = fillHolesFilter;
+    }
 
-    vtkSmartPointer<vtkPolyData> polyData = fillHolesFilter->GetOutput();
+    if (decimation) {
+        vtkSmartPointer<vtkQuadricDecimation> meshDecimator = vtkSmartPointer<vtkQuadricDecimation>::New();
+        if (last) {
+            // patches of filled holes are polygons, decimation takes triangles only
+            vtkSmartPointer<vtkTriangleFilter> triangleFilter = vtkSmartPointer<vtkTriangleFilter>::New();
+            triangleFilter->SetInputConnection(last->GetOutputPort());
+            meshDecimator->SetInputConnection(triangleFilter->GetOutputPort());
+        }
+        else {
+            meshDecimator->SetInputData(input);
+        }
+        meshDecimator->SetTargetReduction(params->DECtargetReductionFactor); // percents
+        progress::observe(meshDecimator);
+        last = meshDecimator;
+    }
 
-    pcl::VTKUtils::vtk2mesh(polyData, *trianglesOut);
-}
+    vtkSmartPointer<vtkPolyData> output = input;
+    if (last) {
+        progress::update(0.0, "Mesh post-processing");
+        last->Update();
+        progress::check();
+        output = vtkPolyData::SafeDownCast(last->GetOutputDataObject(0));
+    }
 
-/** \brief Mesh decimation algorithm performed by VTK library
-  * \param cloudToPolygonate pointer to input mesh
-  * \param output pointer to resultant mesh
-  */
-void mesh::meshDecimation(pcl::PolygonMesh::Ptr trianglesIn, pcl::PolygonMesh::Ptr trianglesOut) {
-    parameters* params = parameters::GetInstance();
-    pcl::MeshQuadricDecimationVTK meshDecimator;
-    meshDecimator.setInputMesh(trianglesIn);
-    meshDecimator.setTargetReductionFactor(params->DECtargetReductionFactor); // percents
-    meshDecimator.process(*trianglesOut);
-    PCL_INFO("Triangles count reduced from %d to %d\n", trianglesIn->polygons.size(), trianglesOut->polygons.size());
+    trianglesOut->fromPolyData(output);
+    if (shown != NULL) {
+        *shown = output;
+    }
+    PCL_INFO("Triangles count changed from %d to %d\n", before, trianglesOut->triangleCount());
 }
 
 /** \brief Triangulation performed by grid projection triangulation
   * \param cloudToPolygonate pointer to input cloud
   * \param output pointer to resultant mesh
   */
-void mesh::polygonateCloudGridProj(PointCloudT::Ptr cloudToPolygonate, pcl::PolygonMesh::Ptr triangles) {
+void mesh::polygonateCloudGridProj(PointCloudT::Ptr cloudToPolygonate, trimesh::Ptr triangles) {
     PCL_INFO("Grid projection polygonation\n");
     parameters* params = parameters::GetInstance();
 
-    //Normal Estimation
-    pcl::NormalEstimation<PointT, pcl::Normal> normEstim;
-    pcl::PointCloud<pcl::Normal>::Ptr normals (new pcl::PointCloud<pcl::Normal>);
-    pcl::search::KdTree<PointT>::Ptr tree2 (new pcl::search::KdTree<PointT>);
-    normEstim.setInputCloud(cloudToPolygonate);
-    normEstim.setSearchMethod(tree2);
-    normEstim.setKSearch(20);
-    normEstim.compute(*normals);
-
-    // concatenate the cloud with the normal fields
-    PointCloudRGBNT::Ptr cloud_normals (new PointCloudRGBNT);
-    pcl::concatenateFields(*cloudToPolygonate,*normals,*cloud_normals);
+    //Normal Estimation, cloud concatenated with the normal fields
+    PointCloudRGBNT::Ptr cloud_normals = cache::withNormals(cloudToPolygonate, 20, 0.0f);
 
     pcl::search::KdTree<NormalRGBT>::Ptr tree_normal (new pcl::search::KdTree<NormalRGBT>);
     //pcl::search::OrganizedNeighbor<NormalRGBT>::Ptr tree_normal (new pcl::search::OrganizedNeighbor<NormalRGBT>); //only for organized cloud
     tree_normal->setInputCloud(cloud_normals);
+    progress::update(0.3, "Grid projection");
+    progress::check();
 
     pcl::GridProjection<NormalRGBT> gp;
     gp.setInputCloud (cloud_normals);
     gp.setSearchMethod (tree_normal);
     gp.setResolution (params->GRres);
-    gp.reconstruct (*triangles);
+    pcl::PolygonMesh polygons;
+    gp.reconstruct (polygons);
+    progress::check();
+    triangles->fromPolygonMesh(polygons);
     //retextureMesh(cloudToPolygonate, triangles);
-    PCL_INFO("Polygons created: %d\n", triangles->polygons.size());
+    PCL_INFO("Polygons created: %d\n", triangles->triangleCount());
 }
 
 /** \brief Experimantal algorithm to map RGB values from input cloud to output mesh
   * \param originCloud pointer to input cloud
   * \param triangles pointer to resultant mesh
   */
-void mesh::retextureMesh(PointCloudT::Ptr originCloud, pcl::PolygonMesh::Ptr triangles) {
+void mesh::retextureMesh(PointCloudT::Ptr originCloud, trimesh::Ptr triangles) {
     PCL_INFO("recoloring\n");
-    pcl::KdTreeFLANN<PointT> kdtree;
-    kdtree.setInputCloud (originCloud);
+    pcl::search::KdTree<PointT>::Ptr kdtree = cache::kdtree (originCloud);
     PointT searchPoint;
     int K = 3;
 
-    PointCloudT::Ptr temp_cloud(new PointCloudT);
-    pcl::fromPCLPointCloud2(triangles->cloud, *temp_cloud);
+    // colors are recomputed in place, no vertex cloud is converted
+    if (!triangles->hasColors()) {
+        triangles->colors.assign(triangles->vertexCount(), 0xffffffff);
+    }
 
     std::vector<int> pointIdxNKNSearch(K);
     std::vector<float> pointNKNSquaredDistance(K);
 
-    for (int i = 0; i < temp_cloud->points.size(); i++) {
-        searchPoint.x = temp_cloud->points[i].x;
-        searchPoint.y = temp_cloud->points[i].y;
-        searchPoint.z = temp_cloud->points[i].z;
+    for (int i = 0; i < triangles->vertexCount(); i++) {
+        searchPoint.x = triangles->positions[3 * i];
+        searchPoint.y = triangles->positions[3 * i + 1];
+        searchPoint.z = triangles->positions[3 * i + 2];
 
         //size_t size = pointIdxNKNSearch.size ();
-        if ( kdtree.nearestKSearch (searchPoint, K, pointIdxNKNSearch, pointNKNSquaredDistance) > 0 )
+        if ( kdtree->nearestKSearch (searchPoint, K, pointIdxNKNSearch, pointNKNSquaredDistance) > 0 )
         {
-            temp_cloud->points[i].r = originCloud->points[pointIdxNKNSearch[0]].r;
-            temp_cloud->points[i].g = originCloud->points[pointIdxNKNSearch[0]].g;
-            temp_cloud->points[i].b = originCloud->points[pointIdxNKNSearch[0]].b;
+            // rgb of nearest point, alpha of vertex is kept
+            triangles->colors[i] = (triangles->colors[i] & 0xff000000u) | (originCloud->points[pointIdxNKNSearch[0]].rgba & 0x00ffffffu);
         }
     }
-
-    parameters* params = parameters::GetInstance();
-    temp_cloud->sensor_orientation_ = params->m;
-    pcl::toPCLPointCloud2(*temp_cloud,triangles->cloud);
-
 }
-
-
@@ -20,24 +20,28 @@
 
 #include "types.h"
 #include "parameters.h"
+#include "progress.h"
 #include "boost/property_tree/ptree.hpp"
 #include "boost/property_tree/json_parser.hpp"
 #include <pcl/surface/gp3.h>
 #include <pcl/features/normal_3d.h>
 #include <pcl/kdtree/kdtree_flann.h>
 #include <pcl/features/normal_3d_omp.h>
-#include <pcl/surface/vtk_smoothing/vtk_mesh_smoothing_laplacian.h>
 #include <pcl/surface/marching_cubes_hoppe.h>
 #include <pcl/surface/marching_cubes_rbf.h>
 #include <pcl/surface/marching_cubes.h>
-#include <pcl/surface/vtk_smoothing/vtk_utils.h>
 #include <vtkFillHolesFilter.h>
+#include <vtkQuadricDecimation.h>
+#include <vtkSmoothPolyDataFilter.h>
+#include <vtkTriangleFilter.h>
 #include <pcl/surface/poisson.h>
 #include <pcl/filters/passthrough.h>
-#include <pcl/surface/vtk_smoothing/vtk_mesh_quadric_decimation.h>
 #include <pcl/surface/grid_projection.h>
 #include <pcl/PCLPointCloud2.h>
 #include <pcl/conversions.h>
+#include "marchingcubes.h"
+#include "trimesh.h"
+#include "cache.h"
 
 
 class mesh
@@ -45,14 +49,13 @@ class mesh
 
 public:
     mesh();
-    static void smoothMesh(pcl::PolygonMesh::Ptr meshToSmooth, pcl::PolygonMesh::Ptr output); //todo bad allocation
-    static void polygonateCloudGreedyProj(PointCloudT::Ptr cloudToPolygonate, pcl::PolygonMesh::Ptr triangles);
-    static void polygonateCloudMC(PointCloudT::Ptr cloudToPolygonate, pcl::PolygonMesh::Ptr triangles); //bug in pcl
-    static void fillHoles(pcl::PolygonMesh::Ptr trianglesIn, pcl::PolygonMesh::Ptr trianglesOut);
-    static void polygonateCloudPoisson(PointCloudT::Ptr cloudToPolygonate, pcl::PolygonMesh::Ptr triangles);
-    static void meshDecimation(pcl::PolygonMesh::Ptr trianglesIn, pcl::PolygonMesh::Ptr trianglesOut);
-    static void polygonateCloudGridProj(PointCloudT::Ptr cloudToPolygonate, pcl::PolygonMesh::Ptr triangles);
-    static void retextureMesh(PointCloudT::Ptr originCloud, pcl::PolygonMesh::Ptr triangles);
+    static void smoothMesh(trimesh::Ptr meshToSmooth, trimesh::Ptr output);
+    static void polygonateCloudGreedyProj(PointCloudT::Ptr cloudToPolygonate, trimesh::Ptr triangles);
+    static void polygonateCloudMC(PointCloudT::Ptr cloudToPolygonate, trimesh::Ptr triangles);
+    static void polygonateCloudPoisson(PointCloudT::Ptr cloudToPolygonate, trimesh::Ptr triangles);
+    static void postProcess(trimesh::Ptr trianglesIn, trimesh::Ptr trianglesOut, bool holes, bool decimation, vtkSmartPointer<vtkPolyData> *shown);
+    static void polygonateCloudGridProj(PointCloudT::Ptr cloudToPolygonate, trimesh::Ptr triangles);
+    static void retextureMesh(PointCloudT::Ptr originCloud, trimesh::Ptr triangles);
 
 };
 
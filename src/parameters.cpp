@@ -0,0 +1,155 @@
+/*
+    This file is part of RoomScanner.
+
+    RoomScanner is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    RoomScanner is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with RoomScanner.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "parameters.h"
+#include <pcl/console/print.h>
+#include <boost/property_tree/ptree.hpp>
+#include <boost/property_tree/json_parser.hpp>
+#include <fstream>
+
+parameters* parameters::instance = 0;
+thread_local parameters* parameters::local = 0;
+
+/** \brief Reads parameters from config file into shared instance, gui and headless runs share it
+  * \param fileName path of json config file
+  * \return true if file was read, defaults stay if it is missing
+  */
+bool loadParameters(const std::string &fileName) {
+    parameters* params = parameters::GetInstance();
+    std::ifstream config_file(fileName.c_str());
+
+    if (config_file.fail()) {
+        PCL_INFO("Config file %s not found, using defaults\n", fileName.c_str());
+        return false;
+    }
+    try {
+        using boost::property_tree::ptree;
+        ptree pt;
+        read_json(config_file, pt);
+
+        for (auto & array_element: pt) {
+            PCL_INFO("%s\n", array_element.first.c_str());
+            for (auto & property: array_element.second) {
+                PCL_INFO(" %s = %s\n", property.first.c_str(), property.second.get_value < std::string > ().c_str());
+            }
+            PCL_INFO("\n");
+        }
+
+        params->VGFleafSize = pt.get<float>("gridFilter.leafSize");
+
+        params->MLSpolynomialOrder = pt.get<int>("mls.polynomialOrder");
+        params->MLSusePolynomialFit = pt.get<bool>("mls.usePolynomialFit");
+        params->MLSsearchRadius = pt.get<double>("mls.searchRadius");
+        params->MLSsqrGaussParam = pt.get<double>("mls.sqrGaussParam");
+        params->MLSupsamplingRadius = pt.get<double>("mls.upsamplingRadius");
+        params->MLSupsamplingStepSize = pt.get<double>("mls.upsamplingStepSize");
+        params->MLSdilationIterations = pt.get<int>("mls.dilationIterations");
+        params->MLSdilationVoxelSize = pt.get<double>("mls.dilationVoxelSize");
+        params->MLScomputeNormals = pt.get<bool>("mls.computeNormals");
+        params->MLStileSize = pt.get<double>("mls.tileSize");
+        params->MLSmemoryLimit = pt.get<double>("mls.memoryLimit");
+
+        params->GPsearchRadius = pt.get<double>("greedyProjection.searchRadius");
+        params->GPmu = pt.get<double>("greedyProjection.mu");
+        params->GPmaximumNearestNeighbors = pt.get<int>("greedyProjection.maximumNearestNeighbors");
+
+        params->SIFTmin_scale = pt.get<double>("SIFT.min_scale");
+        params->SIFTn_octaves = pt.get<int>("SIFT.n_octaves");
+        params->SIFTn_scales_per_octave = pt.get<int>("SIFT.n_scales_per_octave");
+        params->SIFTmin_contrast = pt.get<double>("SIFT.min_contrast");
+
+        params->KEYdetector = pt.get<std::string>("keypoints.detector");
+        params->KEYuniformRadius = pt.get<double>("keypoints.uniformRadius");
+        params->ISSsalientRadius = pt.get<double>("ISS.salientRadius");
+        params->ISSnonMaxRadius = pt.get<double>("ISS.nonMaxRadius");
+        params->ISSgamma21 = pt.get<double>("ISS.gamma21");
+        params->ISSgamma32 = pt.get<double>("ISS.gamma32");
+        params->ISSminNeighbors = pt.get<int>("ISS.minNeighbors");
+        params->HARradius = pt.get<double>("harris.radius");
+        params->HARthreshold = pt.get<double>("harris.threshold");
+        params->HARnonMaxSupression = pt.get<bool>("harris.nonMaxSupression");
+
+        params->REGnormalsRadius = pt.get<double>("registration.normalsRadius");
+        params->REGfpfh = pt.get<double>("registration.fpfh");
+        params->REGreject = pt.get<double>("registration.reject");
+        params->REGcorrDist = pt.get<double>("registration.corrDist");
+
+        params->ORBfeatures = pt.get<int>("orb.features");
+        params->ORBminInliers = pt.get<int>("orb.minInliers");
+        params->ORBinlierThreshold = pt.get<double>("orb.inlierThreshold");
+        params->ORBmaxIterations = pt.get<int>("orb.maxIterations");
+
+        params->PRIORmaxDist = pt.get<double>("motionPrior.maxDist");
+        params->PRIORminFitness = pt.get<double>("motionPrior.minFitness");
+        params->PRIORiterations = pt.get<int>("motionPrior.iterations");
+
+        params->OUTfast = pt.get<bool>("outlierRemoval.fast");
+        params->OUTwindow = pt.get<int>("outlierRemoval.window");
+        params->OUTminNeighbors = pt.get<int>("outlierRemoval.minNeighbors");
+
+        params->PREcapture = pt.get<std::string>("preprocess.capture");
+        params->PREload = pt.get<std::string>("preprocess.load");
+        params->PREoutlierRadius = pt.get<double>("preprocess.outlierRadius");
+
+        params->FBFsigmaS = pt.get<double>("fastBFilter.sigmaS");
+        params->FBFsigmaR = pt.get<double>("fastBFilter.sigmaR");
+
+        params->DECtargetReductionFactor = pt.get<double>("decimation.targetReductionFactor");
+
+        params->HOLsize = pt.get<double>("holeFill.size");
+
+        params->GRres = pt.get<double>("gridProj.size");
+
+        params->POSdepth = pt.get<int>("poissonProj.depth");
+
+        params->MCresolution = pt.get<double>("marchingCubes.resolution");
+        params->MCdistIgnore = pt.get<double>("marchingCubes.distIgnore");
+
+        params->TSDFvoxelSize = pt.get<double>("tsdf.voxelSize");
+        params->TSDFtruncation = pt.get<double>("tsdf.truncation");
+        params->TSDFmaxWeight = pt.get<double>("tsdf.maxWeight");
+        params->TSDFmaxDepth = pt.get<double>("tsdf.maxDepth");
+        params->TSDFfocal = pt.get<double>("tsdf.focal");
+
+        params->NORintegral = pt.get<bool>("normals.integral");
+        params->NORsmoothing = pt.get<double>("normals.smoothing");
+        params->NORmaxDepthChange = pt.get<double>("normals.maxDepthChange");
+
+        params->COMPACTresolution = pt.get<double>("compact.resolution");
+
+        params->CHUNKsize = pt.get<double>("outOfCore.chunkSize");
+        params->CHUNKbudget = pt.get<double>("outOfCore.memoryBudget");
+        params->CHUNKpath = pt.get<std::string>("outOfCore.path");
+
+        params->CACHEnormals = pt.get<int>("cache.normals");
+        params->CACHEtrees = pt.get<int>("cache.trees");
+
+        params->MEMObudget = pt.get<double>("memo.memoryBudget");
+        params->MEMOspill = pt.get<bool>("memo.spill");
+        params->MEMOpath = pt.get<std::string>("memo.path");
+
+        params->LODinteractive = pt.get<int>("lod.interactivePoints");
+        params->LODbudget = pt.get<int>("lod.points");
+        params->LODpixelSpacing = pt.get<double>("lod.pixelSpacing");
+    }
+    catch (const boost::property_tree::ptree_error &e) {
+        PCL_ERROR("Config file %s is invalid: %s\n", fileName.c_str(), e.what());
+        return false;
+    }
+    PCL_INFO("Config file loaded\n");
+    return true;
+}
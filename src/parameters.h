@@ -18,23 +18,35 @@
 #ifndef PARAMETERS_H
 #define PARAMETERS_H
 
+#include <Eigen/Geometry>
 #include <iostream>
+#include <string>
 
 class parameters
 {
 
 private:
     static parameters* instance;
+    // parameters of current thread, set by jobs running with their own values
+    static thread_local parameters* local;
     parameters() {}
 public:
     // singleton class
     static parameters *GetInstance() {
+        if (local != NULL) {
+            return local;
+        }
         if (instance == NULL) {
             instance = new parameters();
         }
         return instance;
     }
 
+    // replaces parameters of calling thread, NULL restores shared instance
+    static void SetLocalInstance(parameters *params) {
+        local = params;
+    }
+
     Eigen::Quaternionf m;
 
     // Default parameters (config file is not found)
@@ -45,6 +57,23 @@ public:
     int SIFTn_scales_per_octave = 10;
     double SIFTmin_contrast = 0.3;
 
+    // Keypoint detectors used by registration, joined by '+'
+    // (sift, iss, harris, uniform)
+    std::string KEYdetector = "sift+uniform";
+    double KEYuniformRadius = 0.1;
+
+    // Parameters for ISS keypoints
+    double ISSsalientRadius = 0.06;
+    double ISSnonMaxRadius = 0.04;
+    double ISSgamma21 = 0.975;
+    double ISSgamma32 = 0.975;
+    int ISSminNeighbors = 5;
+
+    // Parameters for Harris 3D keypoints
+    double HARradius = 0.05;
+    double HARthreshold = 0.0001;
+    bool HARnonMaxSupression = true;
+
     // Parameters for MLS
     int MLSpolynomialOrder = 2;
     bool MLSusePolynomialFit = true;
@@ -55,6 +84,9 @@ public:
     int MLSdilationIterations = 2;
     double MLSdilationVoxelSize = 0.01;
     bool MLScomputeNormals = false;
+    // tiles are halved until the biggest one fits, limit in MB
+    double MLStileSize = 1.0;
+    double MLSmemoryLimit = 2048;
 
     // Parameters for Voxel Grid
     double VGFleafSize = 0.02;
@@ -72,10 +104,62 @@ public:
     //icp
     double REGcorrDist = 0.2;
 
+    // Parameters for ORB coarse registration
+    int ORBfeatures = 1000;
+    int ORBminInliers = 20;
+    double ORBinlierThreshold = 0.03;
+    int ORBmaxIterations = 1000;
+
+    // Parameters for constant velocity motion prior
+    double PRIORmaxDist = 0.05;
+    double PRIORminFitness = 0.8;
+    int PRIORiterations = 20;
+
+    // Parameters for outlier removal of captured frames
+    bool OUTfast = true;
+    int OUTwindow = 4;
+    int OUTminNeighbors = 5;
+
+    // Preprocessing stages of captured and loaded frames, joined by '+'
+    // (color, bilateral, outlier, dropNaN)
+    std::string PREcapture = "bilateral+outlier";
+    std::string PREload = "bilateral";
+    double PREoutlierRadius = 0.8;
+
     // Parameters for Fast Bilateral Filter
     double FBFsigmaS = 10;
     double FBFsigmaR = 0.1;
 
+    // Integral image normals of organized clouds
+    bool NORintegral = true;
+    double NORsmoothing = 10.0;
+    double NORmaxDepthChange = 0.02;
+
+    // Number of normal clouds kept for reuse by later stages
+    int CACHEnormals = 8;
+    // Number of kd-trees kept, each keeps its cloud alive
+    int CACHEtrees = 4;
+
+    // Memory budget in MB of memoized stage results, 0 disables memoization,
+    // results over budget are dropped or spilled to files prefixed by path
+    double MEMObudget = 1024;
+    bool MEMOspill = false;
+    std::string MEMOpath = "memo";
+
+    // Step of quantized coordinates of frames at rest
+    double COMPACTresolution = 0.001;
+
+    // Parameters for out-of-core processing of clouds bigger than memory budget in MB
+    double CHUNKsize = 2.0;
+    double CHUNKbudget = 4096;
+    std::string CHUNKpath = "chunks";
+
+    // Level of detail of displayed clouds, most points rendered while camera moves
+    // and while it is idle, nodes with samples closer in pixels are not refined
+    int LODinteractive = 500000;
+    int LODbudget = 3000000;
+    double LODpixelSpacing = 1.0;
+
     // Parameter for mesh decimation
     double DECtargetReductionFactor = 0.2; // 20%
 
@@ -88,8 +172,24 @@ public:
     // Parameter for Poisson
     int POSdepth = 9;
 
+    // Parameters for Marching cubes
+    double MCresolution = 0.01;
+    double MCdistIgnore = 0.03;
+
+    // Parameters for TSDF fusion
+    double TSDFvoxelSize = 0.01;
+    double TSDFtruncation = 0.04;
+    double TSDFmaxWeight = 64;
+    double TSDFmaxDepth = 4.0;
+    // Kinect intrinsics, focal length for 640x480 image
+    double TSDFfocal = 525.0;
+    int TSDFwidth = 640;
+    int TSDFheight = 480;
+
 };
 
 
 
+bool loadParameters(const std::string &fileName);
+
 #endif // PARAMETERS_H
@@ -0,0 +1,209 @@
+/*
+    This file is part of RoomScanner.
+
+    RoomScanner is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    RoomScanner is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with RoomScanner.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "pool.h"
+#include <mutex>
+#include <vector>
+#include <algorithm>
+
+namespace {
+
+std::mutex poolMutex;
+int runningJobs = 0;
+thread_local pool::jobPtr currentJob;
+
+// idle clouds of one point type, never destroyed so clouds released at exit have a place to go
+template <typename CloudType>
+struct bufferPool {
+    std::vector<CloudType*> idle;
+
+    static bufferPool &instance() {
+        static bufferPool *buffers = new bufferPool();
+        return *buffers;
+    }
+};
+
+template <typename CloudType>
+size_t capacityBytes(const CloudType &cloud) {
+    return cloud.points.capacity() * sizeof(typename CloudType::PointType);
+}
+
+// deleter which empties cloud and gives it back with its buffer, growth counts into job which took it
+template <typename CloudType>
+class recycler {
+public:
+    recycler(size_t bytes, const pool::jobPtr &owner) : bytes(bytes), owner(owner) {}
+
+    void operator()(CloudType *cloud) const {
+        const size_t current = capacityBytes(*cloud);
+        cloud->points.clear();
+        cloud->header = pcl::PCLHeader();
+        cloud->width = 0;
+        cloud->height = 0;
+        cloud->is_dense = true;
+        cloud->sensor_origin_.setZero();
+        cloud->sensor_orientation_.setIdentity();
+
+        std::lock_guard<std::mutex> lock(poolMutex);
+        if (owner) {
+            pool::statistics &counters = owner->counters;
+            if (current > bytes) {
+                counters.grown++;
+            }
+            // bytes lent to job peak just before they come back
+            counters.bytes = counters.bytes + current - bytes;
+            counters.peakBytes = std::max(counters.peakBytes, counters.bytes);
+            counters.bytes -= current;
+        }
+        bufferPool<CloudType>::instance().idle.push_back(cloud);
+    }
+
+private:
+    size_t bytes;
+    pool::jobPtr owner;
+};
+
+template <typename CloudType>
+typename CloudType::Ptr acquire() {
+    const pool::jobPtr owner = currentJob;
+    std::lock_guard<std::mutex> lock(poolMutex);
+    std::vector<CloudType*> &idle = bufferPool<CloudType>::instance().idle;
+    CloudType *cloud;
+    bool allocated = idle.empty();
+    if (allocated) {
+        cloud = new CloudType;
+    }
+    else {
+        cloud = idle.back();
+        idle.pop_back();
+    }
+    const size_t bytes = capacityBytes(*cloud);
+    if (owner) {
+        pool::statistics &counters = owner->counters;
+        counters.acquired++;
+        counters.allocated += allocated;
+        counters.bytes += bytes;
+        counters.peakBytes = std::max(counters.peakBytes, counters.bytes);
+    }
+    return typename CloudType::Ptr(cloud, recycler<CloudType>(bytes, owner));
+}
+
+template <typename CloudType>
+void freeIdle() {
+    std::vector<CloudType*> &idle = bufferPool<CloudType>::instance().idle;
+    for (size_t i = 0; i < idle.size(); i++) {
+        delete idle[i];
+    }
+    std::vector<CloudType*>().swap(idle);
+}
+
+}
+
+/** \brief Empty cloud from pool, it goes back to pool when last pointer to it is gone
+  * \return pointer to cloud
+  */
+PointCloudT::Ptr pool::cloud() {
+    return acquire<PointCloudT>();
+}
+
+/** \brief Empty cloud with normals from pool, it goes back to pool when last pointer to it is gone
+  * \return pointer to cloud
+  */
+PointCloudWithNormals::Ptr pool::normalCloud() {
+    return acquire<PointCloudWithNormals>();
+}
+
+/** \brief Starts job and makes it current for calling thread, job nested in current one
+  * counts into it
+  * \param name name of job in report
+  */
+pool::job::job(const std::string &name) {
+    if (currentJob) {
+        return;
+    }
+    state.reset(new jobState);
+    state->name = name;
+    statistics empty = {0, 0, 0, 0, 0};
+    state->counters = empty;
+    currentJob = state;
+    std::lock_guard<std::mutex> lock(poolMutex);
+    runningJobs++;
+}
+
+/** \brief Ends job, the outermost job reports its counters, idle buffers are freed
+  * when no other job runs
+  */
+pool::job::~job() {
+    if (!state) {
+        return;
+    }
+    currentJob.reset();
+    statistics current;
+    bool last;
+    {
+        std::lock_guard<std::mutex> lock(poolMutex);
+        current = state->counters;
+        last = --runningJobs == 0;
+    }
+    PCL_INFO("Job %s: %d clouds acquired, %d allocated, %d buffers grown, peak %g MB\n",
+             state->name.c_str(), current.acquired, current.allocated, current.grown, current.peakBytes / (1024.0 * 1024.0));
+    if (last) {
+        release();
+    }
+}
+
+/** \brief Makes job current in worker thread, parallel loops take it by current() before
+  * entering worker threads
+  * \param state job of thread which started the loop, may be empty
+  */
+pool::worker::worker(const jobPtr &state) {
+    previous = currentJob;
+    currentJob = state;
+}
+
+/** \brief Restores job the worker thread had before
+  */
+pool::worker::~worker() {
+    currentJob = previous;
+}
+
+/** \brief Frees buffers of all idle clouds, clouds still in use come back later
+  */
+void pool::release() {
+    std::lock_guard<std::mutex> lock(poolMutex);
+    freeIdle<PointCloudT>();
+    freeIdle<PointCloudWithNormals>();
+}
+
+/** \brief Job of calling thread
+  * \return job or empty pointer if thread runs no job
+  */
+pool::jobPtr pool::current() {
+    return currentJob;
+}
+
+/** \brief Counters of job of calling thread
+  * \return copy of counters, zero if thread runs no job
+  */
+pool::statistics pool::stats() {
+    statistics counters = {0, 0, 0, 0, 0};
+    const jobPtr job = currentJob;
+    if (job) {
+        std::lock_guard<std::mutex> lock(poolMutex);
+        counters = job->counters;
+    }
+    return counters;
+}
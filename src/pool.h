@@ -0,0 +1,73 @@
+/*
+    This file is part of RoomScanner.
+
+    RoomScanner is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    RoomScanner is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with RoomScanner.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef POOL_H
+#define POOL_H
+
+#include "types.h"
+#include <boost/shared_ptr.hpp>
+#include <string>
+
+// Reusable temporary clouds of processing jobs. Released clouds keep their
+// point buffers for the next request and all idle buffers are freed together
+// when the last running job ends. Every job keeps its own counters, the job
+// is current for the thread running it like the job of progress.
+class pool
+{
+public:
+    static PointCloudT::Ptr cloud();
+    static PointCloudWithNormals::Ptr normalCloud();
+
+    static void release();
+
+    // counters of one job
+    struct statistics {
+        size_t acquired;
+        size_t allocated;
+        size_t grown;
+        size_t bytes;
+        size_t peakBytes;
+    };
+
+    struct jobState {
+        std::string name;
+        statistics counters;
+    };
+    typedef boost::shared_ptr<jobState> jobPtr;
+
+    static jobPtr current();
+    static statistics stats();
+
+    // job lasting until end of scope, jobs nested in the same thread count into the outer one
+    class job {
+    public:
+        job(const std::string &name);
+        ~job();
+    private:
+        jobPtr state; // empty for nested job
+    };
+
+    // worker thread of parallel loop counting into job taken before the loop, until end of scope
+    class worker {
+    public:
+        worker(const jobPtr &state);
+        ~worker();
+    private:
+        jobPtr previous;
+    };
+};
+
+#endif // POOL_H
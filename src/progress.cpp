@@ -0,0 +1,198 @@
+/*
+    This file is part of RoomScanner.
+
+    RoomScanner is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    RoomScanner is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with RoomScanner.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "progress.h"
+#include <vtkAlgorithm.h>
+#include <vtkCallbackCommand.h>
+#include <vtkCommand.h>
+#include <vtkSmartPointer.h>
+#include <algorithm>
+
+thread_local progress::Ptr progress::currentJob;
+
+namespace {
+
+// forwards progress of vtk filter and aborts it when job is cancelled
+void vtkProgress(vtkObject *caller, unsigned long, void *clientData, void *) {
+    vtkAlgorithm *algorithm = static_cast<vtkAlgorithm *>(caller);
+    progress *job = static_cast<progress *>(clientData);
+    job->report(algorithm->GetProgress());
+    if (job->isCancelled()) {
+        algorithm->SetAbortExecute(1);
+    }
+}
+
+}
+
+/** \brief Creates job
+  * \param name name of job shown with its progress
+  * \param parent job whose cancellation cancels this one too
+  */
+progress::progress(const std::string &name, const Ptr &parent)
+    : name(name), parent(parent), cancelRequested(false), fraction(0.0), percent(-1)
+{
+    sections.push_back(std::make_pair(0.0, 1.0));
+}
+
+/** \brief Requests cancellation, stages stop at their next check
+  */
+void progress::cancel() {
+    cancelRequested = true;
+}
+
+/** \brief True if job or its parent was cancelled
+  */
+bool progress::isCancelled() const {
+    return cancelRequested || (parent && parent->isCancelled());
+}
+
+/** \brief Reports progress of current section, listener is called when whole percent or stage changes
+  * \param fraction done part of current section between 0 and 1
+  * \param stage name of running stage, previous name is kept if empty
+  */
+void progress::report(double fraction, const std::string &stage) {
+    listener function;
+    double total;
+    std::string name;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        const std::pair<double, double> &range = sections.back();
+        this->fraction = range.first + std::min(1.0, std::max(0.0, fraction)) * (range.second - range.first);
+        const int current = static_cast<int>(this->fraction * 100.0);
+        if (current == percent && (stage.empty() || stage == this->stage)) {
+            return;
+        }
+        percent = current;
+        if (!stage.empty()) {
+            this->stage = stage;
+        }
+        function = notify;
+        total = this->fraction;
+        name = this->stage;
+    }
+    if (function) {
+        function(total, name);
+    }
+}
+
+/** \brief Sets function called on progress, it runs on thread of reporting stage
+  * \param function listener taking fraction of whole job and name of stage
+  */
+void progress::setListener(const listener &function) {
+    std::lock_guard<std::mutex> lock(mutex);
+    notify = function;
+}
+
+/** \brief Done part of whole job between 0 and 1
+  */
+double progress::getFraction() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return fraction;
+}
+
+/** \brief Name of last reported stage
+  */
+std::string progress::getStage() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return stage;
+}
+
+/** \brief Sets job of calling thread
+  * \param job job run by thread, empty pointer if none
+  */
+void progress::setCurrent(const Ptr &job) {
+    currentJob = job;
+}
+
+/** \brief Job of calling thread, parallel loops have to take it before entering worker threads
+  * \return job or empty pointer if thread runs no job
+  */
+progress::Ptr progress::current() {
+    return currentJob;
+}
+
+/** \brief True if job of calling thread was cancelled
+  */
+bool progress::cancelled() {
+    return currentJob && currentJob->isCancelled();
+}
+
+/** \brief Unwinds job of calling thread by exception if it was cancelled,
+  * must not be called inside parallel regions
+  */
+void progress::check() {
+    if (cancelled()) {
+        throw cancelledException();
+    }
+}
+
+/** \brief Reports progress of current section of job of calling thread, does nothing without job
+  * \param fraction done part of current section between 0 and 1
+  * \param stage name of running stage, previous name is kept if empty
+  */
+void progress::update(double fraction, const std::string &stage) {
+    if (currentJob) {
+        currentJob->report(fraction, stage);
+    }
+}
+
+/** \brief Forwards progress of vtk filter to job of calling thread and aborts filter on cancellation,
+  * caller checks job after the filter returns
+  * \param algorithm vtk filter, job must outlive its execution
+  */
+void progress::observe(vtkAlgorithm *algorithm) {
+    if (!currentJob) {
+        return;
+    }
+    vtkSmartPointer<vtkCallbackCommand> callback = vtkSmartPointer<vtkCallbackCommand>::New();
+    callback->SetCallback(vtkProgress);
+    callback->SetClientData(currentJob.get());
+    algorithm->AddObserver(vtkCommand::ProgressEvent, callback);
+}
+
+/** \brief Maps progress of nested stage to part of current section
+  * \param begin start of nested stage as fraction of current section
+  * \param end end of nested stage as fraction of current section
+  */
+progress::section::section(double begin, double end) : job(currentJob) {
+    if (job) {
+        job->push(begin, end);
+        job->report(0.0);
+    }
+}
+
+progress::section::~section() {
+    if (job) {
+        if (!job->isCancelled()) {
+            job->report(1.0);
+        }
+        job->pop();
+    }
+}
+
+void progress::push(double begin, double end) {
+    std::lock_guard<std::mutex> lock(mutex);
+    const std::pair<double, double> &range = sections.back();
+    const double width = range.second - range.first;
+    sections.push_back(std::make_pair(range.first + begin * width, range.first + end * width));
+}
+
+void progress::pop() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (sections.size() > 1) {
+        sections.pop_back();
+    }
+}
@@ -0,0 +1,88 @@
+/*
+    This file is part of RoomScanner.
+
+    RoomScanner is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    RoomScanner is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with RoomScanner.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef PROGRESS_H
+#define PROGRESS_H
+
+#include <boost/shared_ptr.hpp>
+#include <boost/function.hpp>
+#include <boost/atomic.hpp>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <mutex>
+
+class vtkAlgorithm;
+
+// Cancellation token and progress of one background job. The thread running
+// the job makes it current, long stages poll it and report fraction done
+// of their section, the gui or console listens and may cancel it.
+class progress
+{
+public:
+    typedef boost::shared_ptr<progress> Ptr;
+    typedef boost::function<void (double, const std::string &)> listener;
+
+    // thrown by check() to unwind cancelled job, temporaries are freed on the way
+    class cancelledException : public std::runtime_error {
+    public:
+        cancelledException() : std::runtime_error("job cancelled") {}
+    };
+
+    // part of enclosing progress covered by nested stage of current job
+    class section {
+    public:
+        section(double begin, double end);
+        ~section();
+    private:
+        Ptr job;
+    };
+
+    progress(const std::string &name, const Ptr &parent = Ptr());
+
+    void cancel();
+    bool isCancelled() const;
+    void report(double fraction, const std::string &stage = std::string());
+    void setListener(const listener &function);
+    double getFraction() const;
+    std::string getStage() const;
+    const std::string &getName() const { return name; }
+
+    static void setCurrent(const Ptr &job);
+    static Ptr current();
+    static bool cancelled();
+    static void check();
+    static void update(double fraction, const std::string &stage = std::string());
+    static void observe(vtkAlgorithm *algorithm);
+
+private:
+    void push(double begin, double end);
+    void pop();
+
+    std::string name;
+    Ptr parent;
+    boost::atomic<bool> cancelRequested;
+    mutable std::mutex mutex;
+    double fraction;
+    std::string stage;
+    std::vector<std::pair<double, double> > sections;
+    listener notify;
+    int percent;
+
+    static thread_local Ptr currentJob;
+};
+
+#endif // PROGRESS_H
@@ -17,6 +17,24 @@
 
 #include "registration.h"
 
+namespace {
+
+// sum of normals of frame points falling into one voxel, value initialized to zero
+struct normalSum {
+    float x, y, z, curvature;
+    int count;
+};
+
+// voxel of point packed to 21 bits per axis
+inline uint64_t voxelKey (const Eigen::Vector3f &p, float inverse) {
+    const uint64_t x = static_cast<uint64_t> (static_cast<int> (std::floor (p[0] * inverse))) & 0x1fffff;
+    const uint64_t y = static_cast<uint64_t> (static_cast<int> (std::floor (p[1] * inverse))) & 0x1fffff;
+    const uint64_t z = static_cast<uint64_t> (static_cast<int> (std::floor (p[2] * inverse))) & 0x1fffff;
+    return x | (y << 21) | (z << 42);
+}
+
+}
+
 registration::registration()
 {
 
@@ -30,12 +48,13 @@ PointCloudT::Ptr registration::regFrame (new PointCloudT);
   * \param output the resultant aligned source PointCloud
   * \param final_transform the resultant transform between source and target
   * \param downsample bool value if downsample input data
+  * \param iterations number of ICP runs
   */
-void registration::pairAlign (const PointCloudT::Ptr cloud_src, const PointCloudT::Ptr cloud_tgt, PointCloudT::Ptr output, Eigen::Matrix4f &final_transform, bool downsample) {
+void registration::pairAlign (const PointCloudT::Ptr cloud_src, const PointCloudT::Ptr cloud_tgt, PointCloudT::Ptr output, Eigen::Matrix4f &final_transform, bool downsample, int iterations) {
 
     parameters *param = parameters::GetInstance();
-    PointCloudT::Ptr src (new PointCloudT);
-    PointCloudT::Ptr tgt (new PointCloudT);
+    PointCloudT::Ptr src = pool::cloud ();
+    PointCloudT::Ptr tgt = pool::cloud ();
 
     if (downsample)
     {
@@ -50,20 +69,11 @@ void registration::pairAlign (const PointCloudT::Ptr cloud_src, const PointCloud
     }
 
     // compute surface normals and curvature
-    PointCloudWithNormals::Ptr points_with_normals_src (new PointCloudWithNormals);
-    PointCloudWithNormals::Ptr points_with_normals_tgt (new PointCloudWithNormals);
+    PointCloudWithNormals::Ptr points_with_normals_src = pool::normalCloud ();
+    PointCloudWithNormals::Ptr points_with_normals_tgt = pool::normalCloud ();
 
-    pcl::NormalEstimation<PointT, PointNormalT> norm_est;
-    pcl::search::KdTree<PointT>::Ptr tree (new pcl::search::KdTree<PointT> ());
-    norm_est.setSearchMethod (tree);
-    norm_est.setKSearch (30);
-    norm_est.setInputCloud (src);
-    norm_est.compute (*points_with_normals_src);
-    pcl::copyPointCloud (*src, *points_with_normals_src);
-
-    norm_est.setInputCloud (tgt);
-    norm_est.compute (*points_with_normals_tgt);
-    pcl::copyPointCloud (*tgt, *points_with_normals_tgt);
+    pcl::concatenateFields (*src, *cache::normals (src, 30, 0.0f), *points_with_normals_src);
+    pcl::concatenateFields (*tgt, *cache::normals (tgt, 30, 0.0f), *points_with_normals_tgt);
 
     // instantiate custom point representation
     PointRepr point_representation;
@@ -85,10 +95,12 @@ void registration::pairAlign (const PointCloudT::Ptr cloud_src, const PointCloud
     PointCloudWithNormals::Ptr reg_result = points_with_normals_src;
     reg.setMaximumIterations (10);
 
-    for (int i = 0; i < 100; ++i)
+    for (int i = 0; i < iterations; ++i)
     {
 
         PCL_INFO ("Iteration Nr. %d\n", i);
+        progress::update (static_cast<double> (i) / iterations, "ICP");
+        progress::check ();
         points_with_normals_src = reg_result;
         reg.setInputSource (points_with_normals_src);
         reg.align (*reg_result);
@@ -96,7 +108,7 @@ void registration::pairAlign (const PointCloudT::Ptr cloud_src, const PointCloud
         //accumulate transformation between each Iteration
         Ti = reg.getFinalTransformation () * Ti;
 
-        if (i < 98) {
+        if (i < iterations - 2) {
             pcl::transformPointCloud (*src, *(registration::regFrame), Ti); //send undersampled output
             try {
                 emit regFrameSignal();
@@ -129,15 +141,21 @@ void registration::pairAlign (const PointCloudT::Ptr cloud_src, const PointCloud
 /** \brief Computes transdormation between source and target pointcloud
   * \param src_origin the source PointCloud
   * \param tgt_origin the target PointCloud
+  * \param src_frame organized source frame in sensor coordinates, empty if not known
+  * \param src_pose transformation of source frame to coordinates of src_origin
+  * \param tgt_frame organized target frame in sensor coordinates, empty if not known
+  * \param tgt_pose transformation of target frame to coordinates of tgt_origin
   * \return true if transformation found successfully
   */
-bool registration::computeTransformation (const PointCloudT::Ptr &src_origin, const PointCloudT::Ptr &tgt_origin, Eigen::Matrix4f &transform) {
+bool registration::computeTransformation (const PointCloudT::Ptr &src_origin, const PointCloudT::Ptr &tgt_origin, Eigen::Matrix4f &transform,
+                                          const PointCloudT::Ptr &src_frame, const Eigen::Matrix4f &src_pose,
+                                          const PointCloudT::Ptr &tgt_frame, const Eigen::Matrix4f &tgt_pose) {
     PCL_INFO("computeTransformation\n");
     //Eigen::Matrix4f transform;
 
     parameters *params = parameters::GetInstance();
-    PointCloudT::Ptr keypoints_src (new PointCloudT), keypoints_tgt (new PointCloudT);
-    PointCloudT::Ptr src (new PointCloudT), tgt (new PointCloudT);
+    PointCloudT::Ptr keypoints_src = pool::cloud (), keypoints_tgt = pool::cloud ();
+    PointCloudT::Ptr src = pool::cloud (), tgt = pool::cloud ();
 
     filters::voxelGridFilter(src_origin, src, 0.02f); // we want downsampled copies of clouds for computation...direct downsampling would affect output quality
     filters::voxelGridFilter(tgt_origin, tgt, 0.02f);
@@ -151,8 +169,10 @@ bool registration::computeTransformation (const PointCloudT::Ptr &src_origin, co
     filters::oultlierRemoval(*src, *src, 0.5f);
     filters::oultlierRemoval(*tgt, *tgt, 0.5f);*/
 
+    progress::update (0.0, "Keypoints");
     registration::estimateKeypoints (src, *keypoints_src);
     registration::estimateKeypoints (tgt, *keypoints_tgt);
+    progress::check ();
 
     PCL_INFO ("Found %lu and %lu keypoints for the source and target datasets.\n", keypoints_src->points.size (), keypoints_tgt->points.size ());
 
@@ -164,15 +184,31 @@ bool registration::computeTransformation (const PointCloudT::Ptr &src_origin, co
     // compute normals for all points keypoint
     pcl::PointCloud<pcl::Normal>::Ptr normals_src (new pcl::PointCloud<pcl::Normal>),
         normals_tgt (new pcl::PointCloud<pcl::Normal>);
-    registration::estimateNormals (src, *normals_src, params->REGnormalsRadius);
-    registration::estimateNormals (tgt, *normals_tgt, params->REGnormalsRadius);
+    progress::update (0.3, "Normals");
+    // organized frames give normals from integral images before voxelizing
+    if (params->NORintegral && src_frame && src_frame->isOrganized ()) {
+        registration::transferNormals (src_frame, src_pose, *src, *normals_src, 0.02f);
+    }
+    else {
+        registration::estimateNormals (src, *normals_src, params->REGnormalsRadius);
+    }
+    if (params->NORintegral && tgt_frame && tgt_frame->isOrganized ()) {
+        registration::transferNormals (tgt_frame, tgt_pose, *tgt, *normals_tgt, 0.02f);
+    }
+    else {
+        registration::estimateNormals (tgt, *normals_tgt, params->REGnormalsRadius);
+    }
+    progress::check ();
     PCL_INFO ("Estimated %lu and %lu normals for the source and target datasets.\n", normals_src->points.size (), normals_tgt->points.size ());
 
     // compute FPFH features at each keypoint
     pcl::PointCloud<pcl::FPFHSignature33>::Ptr fpfhs_src (new pcl::PointCloud<pcl::FPFHSignature33>),
         fpfhs_tgt (new pcl::PointCloud<pcl::FPFHSignature33>);
+    progress::update (0.5, "FPFH");
     registration::estimateFPFH (src, normals_src, keypoints_src, *fpfhs_src);
     registration::estimateFPFH (tgt, normals_tgt, keypoints_tgt, *fpfhs_tgt);
+    progress::check ();
+    progress::update (0.8, "Correspondences");
 
     // find correspondences between keypoints in FPFH space
     pcl::CorrespondencesPtr all_correspondences (new pcl::Correspondences), good_correspondences (new pcl::Correspondences);
@@ -189,6 +225,130 @@ bool registration::computeTransformation (const PointCloudT::Ptr &src_origin, co
     return true;
 }
 
+/** \brief Computes transformation between organized frames from ORB features of their images
+  * \param src the source organized PointCloud
+  * \param tgt the target organized PointCloud
+  * \param transform resultant transformation from source to target
+  * \return true if enough matches agree on transformation
+  */
+bool registration::computeTransformationORB (const PointCloudT::Ptr &src, const PointCloudT::Ptr &tgt, Eigen::Matrix4f &transform) {
+    PCL_INFO("computeTransformationORB\n");
+    parameters *params = parameters::GetInstance();
+    pcl::console::TicToc tt;
+    tt.tic();
+
+    cv::Mat graySrc, grayTgt, maskSrc, maskTgt;
+    registration::grayImage (src, graySrc, maskSrc);
+    registration::grayImage (tgt, grayTgt, maskTgt);
+
+    // detect and describe binary features only where depth is known
+    cv::Ptr<cv::ORB> orb = cv::ORB::create (params->ORBfeatures);
+    std::vector<cv::KeyPoint> featuresSrc, featuresTgt;
+    cv::Mat descriptorsSrc, descriptorsTgt;
+    orb->detectAndCompute (graySrc, maskSrc, featuresSrc, descriptorsSrc);
+    orb->detectAndCompute (grayTgt, maskTgt, featuresTgt, descriptorsTgt);
+    if (descriptorsSrc.empty () || descriptorsTgt.empty ()) {
+        PCL_INFO("Images have no features!\n");
+        return false;
+    }
+
+    cv::BFMatcher matcher (cv::NORM_HAMMING, true);
+    std::vector<cv::DMatch> matches;
+    matcher.match (descriptorsSrc, descriptorsTgt, matches);
+
+    // lift matched pixels to 3D through organized clouds
+    PointCloudT::Ptr keypoints_src = pool::cloud (), keypoints_tgt = pool::cloud ();
+    pcl::CorrespondencesPtr all_correspondences (new pcl::Correspondences);
+    for (size_t i = 0; i < matches.size (); i++) {
+        const cv::Point2f &ps = featuresSrc[matches[i].queryIdx].pt;
+        const cv::Point2f &pt = featuresTgt[matches[i].trainIdx].pt;
+        const PointT &a = (*src) (static_cast<int> (ps.x + 0.5f), static_cast<int> (ps.y + 0.5f));
+        const PointT &b = (*tgt) (static_cast<int> (pt.x + 0.5f), static_cast<int> (pt.y + 0.5f));
+        if (!pcl::isFinite (a) || !pcl::isFinite (b)) {
+            continue;
+        }
+        all_correspondences->push_back (pcl::Correspondence (keypoints_src->points.size (), keypoints_tgt->points.size (), matches[i].distance));
+        keypoints_src->push_back (a);
+        keypoints_tgt->push_back (b);
+    }
+    PCL_INFO ("ORB found %lu and %lu features, %lu matches with depth\n", featuresSrc.size (), featuresTgt.size (), all_correspondences->size ());
+
+    if (static_cast<int> (all_correspondences->size ()) < params->ORBminInliers) {
+        return false;
+    }
+
+    // reject matches disagreeing with the best rigid transformation
+    pcl::Correspondences good_correspondences;
+    pcl::registration::CorrespondenceRejectorSampleConsensus<PointT> rej;
+    rej.setInputSource (keypoints_src);
+    rej.setInputTarget (keypoints_tgt);
+    rej.setInlierThreshold (params->ORBinlierThreshold);
+    rej.setMaximumIterations (params->ORBmaxIterations);
+    rej.setInputCorrespondences (all_correspondences);
+    rej.getCorrespondences (good_correspondences);
+
+    PCL_INFO ("ORB coarse alignment: %lu inliers in %g ms\n", good_correspondences.size (), tt.toc ());
+    if (static_cast<int> (good_correspondences.size ()) < params->ORBminInliers) {
+        return false;
+    }
+
+    pcl::registration::TransformationEstimationSVD<PointT, PointT> trans_est;
+    trans_est.estimateRigidTransformation (*keypoints_src, *keypoints_tgt, good_correspondences, transform);
+    return true;
+}
+
+/** \brief Measures how well already transformed source fits target
+  * \param src the source PointCloud
+  * \param tgt the target PointCloud
+  * \param maxDist maximal distance of point to its nearest neighbor to be inlier
+  * \return fraction of source points with close neighbor in target
+  */
+double registration::seedFitness (const PointCloudT::Ptr &src, const PointCloudT::Ptr &tgt, float maxDist) {
+    PointCloudT::Ptr sparseSrc = pool::cloud (), sparseTgt = pool::cloud ();
+    filters::voxelGridFilter(src, sparseSrc, 0.05f);
+    filters::voxelGridFilter(tgt, sparseTgt, 0.02f);
+    if (sparseSrc->points.empty () || sparseTgt->points.empty ()) {
+        return 0.0;
+    }
+
+    pcl::search::KdTree<PointT> tree;
+    tree.setInputCloud (sparseTgt);
+    const float maxSqrDist = maxDist * maxDist;
+    int inliers = 0;
+
+#pragma omp parallel reduction(+:inliers)
+    {
+        std::vector<int> index (1);
+        std::vector<float> sqrDist (1);
+#pragma omp for
+        for (int i = 0; i < static_cast<int> (sparseSrc->points.size ()); i++) {
+            if (tree.nearestKSearch (sparseSrc->points[i], 1, index, sqrDist) > 0 && sqrDist[0] <= maxSqrDist) {
+                inliers++;
+            }
+        }
+    }
+    return static_cast<double> (inliers) / sparseSrc->points.size ();
+}
+
+/** \brief Converts colors of organized cloud to grayscale image
+  * \param cloud input organized PointCloud
+  * \param gray resultant 8-bit image
+  * \param mask resultant mask of pixels with valid depth
+  */
+void registration::grayImage (const PointCloudT::Ptr &cloud, cv::Mat &gray, cv::Mat &mask) {
+    gray.create (cloud->height, cloud->width, CV_8UC1);
+    mask.create (cloud->height, cloud->width, CV_8UC1);
+    for (int y = 0; y < static_cast<int> (cloud->height); y++) {
+        unsigned char *g = gray.ptr<unsigned char> (y);
+        unsigned char *m = mask.ptr<unsigned char> (y);
+        for (int x = 0; x < static_cast<int> (cloud->width); x++) {
+            const PointT &p = (*cloud) (x, y);
+            g[x] = static_cast<unsigned char> ((299 * p.r + 587 * p.g + 114 * p.b) / 1000);
+            m[x] = pcl::isFinite (p) ? 255 : 0;
+        }
+    }
+}
+
 /** \brief Rejects bad correspondences
   * \param all_correspondences all found correspondences
   * \param keypoints_src keypoints from source point cloud
@@ -242,9 +402,31 @@ void registration::estimateFPFH (const PointCloudT::Ptr &cloud, const pcl::Point
     pcl::FPFHEstimationOMP<PointT, pcl::Normal, pcl::FPFHSignature33> fpfh_est;
     fpfh_est.setNumberOfThreads(4);
     fpfh_est.setInputCloud (keypoints);
-    fpfh_est.setInputNormals (normals);
     fpfh_est.setRadiusSearch (params->REGfpfh);
-    fpfh_est.setSearchSurface (cloud);
+    bool valid = true;
+    for (size_t i = 0; i < normals->points.size () && valid; i++) {
+        valid = pcl_isfinite (normals->points[i].normal_x);
+    }
+    if (!valid) {
+        // integral image normals are NaN on depth edges, such points can not be part of surface
+        PointCloudT::Ptr surface (new PointCloudT);
+        pcl::PointCloud<pcl::Normal>::Ptr surfaceNormals (new pcl::PointCloud<pcl::Normal>);
+        for (size_t i = 0; i < cloud->points.size (); i++) {
+            if (pcl::isFinite (cloud->points[i]) && pcl_isfinite (normals->points[i].normal_x)) {
+                surface->points.push_back (cloud->points[i]);
+                surfaceNormals->points.push_back (normals->points[i]);
+            }
+        }
+        surface->width = surfaceNormals->width = surface->points.size ();
+        surface->height = surfaceNormals->height = 1;
+        fpfh_est.setInputNormals (surfaceNormals);
+        fpfh_est.setSearchSurface (surface);
+    }
+    else {
+        fpfh_est.setInputNormals (normals);
+        fpfh_est.setSearchSurface (cloud);
+        fpfh_est.setSearchMethod (cache::kdtree (cloud)); // same tree as normals of cloud
+    }
     fpfh_est.compute (fpfh);
 }
 
@@ -256,37 +438,71 @@ void registration::estimateFPFH (const PointCloudT::Ptr &cloud, const pcl::Point
   */
 void registration::estimateNormals (const PointCloudT::Ptr &cloud, pcl::PointCloud<pcl::Normal> &normals, float radius) {
    PCL_INFO("estimateNormals\n");
-    pcl::NormalEstimationOMP<PointT, pcl::Normal> normal_est;
-    normal_est.setNumberOfThreads(4);
-    normal_est.setInputCloud (cloud);
-    normal_est.setRadiusSearch (radius);
-    normal_est.compute (normals);
+    normals = *cache::normals (cloud, 0, radius);
+}
+
+
+/** \brief Normals of voxelized cloud taken from integral image normals of its organized frame,
+  * normals of frame points falling into the same voxel are averaged
+  * \param frame organized frame in sensor coordinates
+  * \param pose transformation of frame to coordinates of cloud
+  * \param cloud frame voxelized in coordinates given by pose
+  * \param normals resultant normals, NaN where no point of voxel has valid normal
+  * \param leaf voxel size the cloud was filtered with
+  */
+void registration::transferNormals (const PointCloudT::Ptr &frame, const Eigen::Matrix4f &pose, const PointCloudT &cloud, pcl::PointCloud<pcl::Normal> &normals, float leaf) {
+    PCL_INFO("transferNormals\n");
+    parameters* params = parameters::GetInstance();
+    // depth edges are found along z of the sensor, normals are rotated afterwards
+    cache::NormalCloud::ConstPtr frameNormals = cache::normals (frame, 0, params->REGnormalsRadius, Eigen::Vector3f::Zero ());
+    const Eigen::Matrix3f rotation = pose.topLeftCorner<3, 3> ();
+    const Eigen::Vector3f translation = pose.topRightCorner<3, 1> ();
+    // keys are computed like in voxel grid filter, centroid of voxel stays in its voxel
+    const float inverse = 1.0f / leaf;
+
+    std::unordered_map<uint64_t, normalSum> sums;
+    for (size_t i = 0; i < frame->points.size (); i++) {
+        const pcl::Normal &n = frameNormals->points[i];
+        if (!pcl::isFinite (frame->points[i]) || !pcl_isfinite (n.normal_x)) {
+            continue;
+        }
+        const Eigen::Vector3f p = rotation * frame->points[i].getVector3fMap () + translation;
+        const Eigen::Vector3f direction = rotation * Eigen::Vector3f (n.normal_x, n.normal_y, n.normal_z);
+        normalSum &sum = sums[voxelKey (p, inverse)];
+        sum.x += direction[0];
+        sum.y += direction[1];
+        sum.z += direction[2];
+        sum.curvature += n.curvature;
+        sum.count++;
+    }
+
+    const float nan = std::numeric_limits<float>::quiet_NaN ();
+    normals.points.resize (cloud.points.size ());
+    for (size_t i = 0; i < cloud.points.size (); i++) {
+        pcl::Normal &n = normals.points[i];
+        std::unordered_map<uint64_t, normalSum>::const_iterator voxel = sums.find (voxelKey (cloud.points[i].getVector3fMap (), inverse));
+        const float length = (voxel == sums.end ()) ? 0.0f : Eigen::Vector3f (voxel->second.x, voxel->second.y, voxel->second.z).norm ();
+        if (length == 0.0f) {
+            n.normal_x = n.normal_y = n.normal_z = n.curvature = nan;
+            continue;
+        }
+        n.normal_x = voxel->second.x / length;
+        n.normal_y = voxel->second.y / length;
+        n.normal_z = voxel->second.z / length;
+        n.curvature = voxel->second.curvature / voxel->second.count;
+    }
+    normals.width = normals.points.size ();
+    normals.height = 1;
+    normals.is_dense = false;
 }
 
 
 /** \brief Finds keypoints of point cloud
   * \param cloud input point cloud
-  * \param resultant keypoints found by SIFT algorithm
+  * \param resultant keypoints found by detectors selected in config
   */
 void registration::estimateKeypoints (const PointCloudT::Ptr &cloud, PointCloudT &keypoints) {
-    parameters* param = parameters::GetInstance();
     PCL_INFO("estimateKeypoints\n");
-    pcl::SIFTKeypoint<PointT, pcl::PointWithScale> sift;
-    pcl::PointCloud<pcl::PointWithScale> result;
-    pcl::search::KdTree<PointT>::Ptr tree(new pcl::search::KdTree<PointT> ());
-    sift.setSearchMethod(tree);
-    sift.setScales(param->SIFTmin_scale, param->SIFTn_octaves, param->SIFTn_scales_per_octave);
-    sift.setMinimumContrast(param->SIFTmin_contrast);
-    sift.setInputCloud(cloud);
-    sift.compute(result);
-
-
-    copyPointCloud(result, keypoints); // from PointWithScale to PointCloudAT
-
-    PCL_INFO ("keypoints %d\n", keypoints.points.size());
-    // get undersampled cloud as "3D keypoints"
-    PointCloudT::Ptr depthKeypoints(new PointCloudT);
-    filters::downsample(cloud, *depthKeypoints, 0.1);
-    keypoints += *depthKeypoints;
+    keypoints::detect(cloud, keypoints);
     PCL_INFO ("keypoints %d\n", keypoints.points.size());
 }
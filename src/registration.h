@@ -29,6 +29,10 @@
 #include <pcl/features/normal_3d.h>
 #include "pointrepr.h"
 #include "filters.h"
+#include "keypoints.h"
+#include "cache.h"
+#include "pool.h"
+#include "progress.h"
 #include "parameters.h"
 #include <pcl/features/normal_3d_omp.h>
 #include <pcl/keypoints/sift_keypoint.h>
@@ -37,6 +41,10 @@
 #include <QObject>
 #include <pcl/registration/transformation_estimation_svd_scale.h>
 #include <pcl/io/pcd_io.h>
+#include <pcl/common/time.h>
+#include <unordered_map>
+#include <pcl/registration/correspondence_rejection_sample_consensus.h>
+#include "opencv2/features2d.hpp"
 
 class registration : public QObject
 {
@@ -44,9 +52,10 @@ class registration : public QObject
 
 public:
     registration();
-    void pairAlign (const PointCloudT::Ptr cloud_src, const PointCloudT::Ptr cloud_tgt, PointCloudT::Ptr output, Eigen::Matrix4f &final_transform, bool downsample = false);
+    void pairAlign (const PointCloudT::Ptr cloud_src, const PointCloudT::Ptr cloud_tgt, PointCloudT::Ptr output, Eigen::Matrix4f &final_transform, bool downsample = false, int iterations = 100);
     static void estimateKeypoints (const PointCloudT::Ptr &cloud, PointCloudT &keypoints);
     static void estimateNormals (const PointCloudT::Ptr &cloud, pcl::PointCloud<pcl::Normal> &normals, float radius);
+    static void transferNormals (const PointCloudT::Ptr &frame, const Eigen::Matrix4f &pose, const PointCloudT &cloud, pcl::PointCloud<pcl::Normal> &normals, float leaf);
     static void estimateFPFH (const PointCloudT::Ptr &cloud, const pcl::PointCloud<pcl::Normal>::Ptr &normals, const PointCloudT::Ptr &keypoints, pcl::PointCloud<pcl::FPFHSignature33> &fpfhs);
     static void findCorrespondences (const pcl::PointCloud<pcl::FPFHSignature33>::Ptr &fpfhs_src,
                                      const pcl::PointCloud<pcl::FPFHSignature33>::Ptr &fpfhs_tgt,
@@ -55,7 +64,12 @@ public:
                                           const PointCloudT::Ptr &keypoints_src,
                                           const PointCloudT::Ptr &keypoints_tgt,
                                           pcl::Correspondences &remaining_correspondences);
-    bool computeTransformation (const PointCloudT::Ptr &src, const PointCloudT::Ptr &tgt, Eigen::Matrix4f &transform);
+    bool computeTransformation (const PointCloudT::Ptr &src, const PointCloudT::Ptr &tgt, Eigen::Matrix4f &transform,
+                                const PointCloudT::Ptr &src_frame = PointCloudT::Ptr (), const Eigen::Matrix4f &src_pose = Eigen::Matrix4f::Identity (),
+                                const PointCloudT::Ptr &tgt_frame = PointCloudT::Ptr (), const Eigen::Matrix4f &tgt_pose = Eigen::Matrix4f::Identity ());
+    static bool computeTransformationORB (const PointCloudT::Ptr &src, const PointCloudT::Ptr &tgt, Eigen::Matrix4f &transform);
+    static double seedFitness (const PointCloudT::Ptr &src, const PointCloudT::Ptr &tgt, float maxDist);
+    static void grayImage (const PointCloudT::Ptr &cloud, cv::Mat &gray, cv::Mat &mask);
 
     static PointCloudT::Ptr regFrame;
 
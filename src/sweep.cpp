@@ -0,0 +1,300 @@
+/*
+    This file is part of RoomScanner.
+
+    RoomScanner is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    RoomScanner is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with RoomScanner.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "sweep.h"
+#include "pool.h"
+#include <pcl/io/pcd_io.h>
+#include <pcl/common/time.h>
+#include <pcl/kdtree/kdtree_flann.h>
+#include <boost/bind.hpp>
+#include <sstream>
+#include <cstdlib>
+#include <csignal>
+#include <cstdio>
+#include <cmath>
+#include <limits>
+
+namespace {
+
+// most points of input compared with mesh
+const int QUALITY_SAMPLES = 20000;
+
+// running sweep, cancelled by ctrl+c
+progress::Ptr running;
+
+void interrupt(int) {
+    // second ctrl+c terminates immediately
+    std::signal(SIGINT, SIG_DFL);
+    if (running) {
+        running->cancel();
+    }
+}
+
+void printProgress(double fraction, const std::string &stage) {
+    std::fprintf(stderr, "[%3d%%] %s\n", static_cast<int>(fraction * 100.0), stage.c_str());
+}
+
+}
+
+/** \brief Parses swept parameter written as name=value,value,...
+  * \param text input text
+  * \param result resultant parameter and its values
+  * \return false if text is malformed or parameter is unknown
+  */
+bool sweep::parseAxis(const std::string &text, axis &result) {
+    const size_t equals = text.find('=');
+    if (equals == std::string::npos) {
+        return false;
+    }
+    result.name = text.substr(0, equals);
+    result.values.clear();
+    std::stringstream ss(text.substr(equals + 1));
+    std::string value;
+    while (std::getline(ss, value, ',')) {
+        char *end;
+        const double number = std::strtod(value.c_str(), &end);
+        if (value.empty() || *end != '\0') {
+            return false;
+        }
+        result.values.push_back(number);
+    }
+    parameters scratch(*parameters::GetInstance());
+    return !result.values.empty() && assign(scratch, result.name, result.values[0]);
+}
+
+/** \brief Sets reconstruction parameter by its name in parameters class
+  * \param params parameters to change
+  * \param name name of member
+  * \param value new value, rounded for integer parameters
+  * \return false if parameter is unknown
+  */
+bool sweep::assign(parameters &params, const std::string &name, double value) {
+    const int integer = static_cast<int>(std::floor(value + 0.5));
+    if (name == "VGFleafSize") params.VGFleafSize = value;
+    else if (name == "GPsearchRadius") params.GPsearchRadius = value;
+    else if (name == "GPmu") params.GPmu = value;
+    else if (name == "GPmaximumNearestNeighbors") params.GPmaximumNearestNeighbors = integer;
+    else if (name == "GRres") params.GRres = value;
+    else if (name == "POSdepth") params.POSdepth = integer;
+    else if (name == "MCresolution") params.MCresolution = value;
+    else if (name == "MCdistIgnore") params.MCdistIgnore = value;
+    else if (name == "HOLsize") params.HOLsize = value;
+    else if (name == "DECtargetReductionFactor") params.DECtargetReductionFactor = value;
+    else if (name == "NORsmoothing") params.NORsmoothing = value;
+    else if (name == "NORmaxDepthChange") params.NORmaxDepthChange = value;
+    else return false;
+    return true;
+}
+
+/** \brief Quality proxy of mesh, distances from sample of input points to nearest mesh vertex
+  * \param cloud input cloud of reconstruction
+  * \param triangles reconstructed mesh
+  * \param tolerance distance of point covered by mesh
+  * \param rms resultant root mean square distance, infinite for empty mesh
+  * \param coverage resultant fraction of sampled points within tolerance
+  */
+void sweep::quality(const PointCloudT &cloud, const trimesh &triangles, float tolerance, double &rms, double &coverage) {
+    pcl::PointCloud<pcl::PointXYZ>::Ptr vertices (new pcl::PointCloud<pcl::PointXYZ>);
+    vertices->points.resize(triangles.vertexCount());
+    for (size_t i = 0; i < triangles.vertexCount(); i++) {
+        vertices->points[i].getVector3fMap() = Eigen::Vector3f::Map(&triangles.positions[3 * i]);
+    }
+    vertices->width = vertices->points.size();
+    vertices->height = 1;
+    rms = std::numeric_limits<double>::infinity();
+    coverage = 0.0;
+    if (vertices->points.empty()) {
+        return;
+    }
+    pcl::KdTreeFLANN<pcl::PointXYZ> tree;
+    tree.setInputCloud(vertices);
+
+    const int step = std::max(1, static_cast<int>(cloud.points.size() / QUALITY_SAMPLES));
+    std::vector<int> index(1);
+    std::vector<float> sqrDistance(1);
+    double sum = 0.0;
+    int covered = 0, samples = 0;
+    for (size_t i = 0; i < cloud.points.size(); i += step) {
+        const PointT &p = cloud.points[i];
+        if (!pcl::isFinite(p)) {
+            continue;
+        }
+        pcl::PointXYZ query;
+        query.x = p.x;
+        query.y = p.y;
+        query.z = p.z;
+        if (tree.nearestKSearch(query, 1, index, sqrDistance) > 0) {
+            sum += sqrDistance[0];
+            covered += sqrDistance[0] <= tolerance * tolerance;
+            samples++;
+        }
+    }
+    if (samples > 0) {
+        rms = std::sqrt(sum / samples);
+        coverage = static_cast<double>(covered) / samples;
+    }
+}
+
+/** \brief Downsamples and reconstructs every cloud with all combinations of swept values
+  * and prints time, triangle count and quality of each, ctrl+c cancels remaining combinations
+  * \param files input pcd files
+  * \param grid swept parameters as name=value,value,...
+  * \param fixed parameters set for all combinations as name=value
+  * \param mesher greedy, grid, poisson or mc
+  * \param holes true to fill holes of meshes
+  * \param decimate true to decimate meshes
+  * \param tolerance distance of point covered by mesh
+  * \return 0 on success
+  */
+int sweep::run(const std::vector<std::string> &files, const std::vector<std::string> &grid, const std::vector<std::string> &fixed,
+               const std::string &mesher, bool holes, bool decimate, float tolerance) {
+    memo::meshStage function;
+    if (mesher == "greedy") {
+        function = &mesh::polygonateCloudGreedyProj;
+    }
+    else if (mesher == "grid") {
+        function = &mesh::polygonateCloudGridProj;
+    }
+    else if (mesher == "poisson") {
+        function = &mesh::polygonateCloudPoisson;
+    }
+    else if (mesher == "mc") {
+        function = &mesh::polygonateCloudMC;
+    }
+    else {
+        PCL_ERROR("Unknown mesher %s\n", mesher.c_str());
+        return 1;
+    }
+
+    parameters base(*parameters::GetInstance());
+    for (size_t i = 0; i < fixed.size(); i++) {
+        axis value;
+        if (!parseAxis(fixed[i], value) || value.values.size() != 1) {
+            PCL_ERROR("Bad parameter %s\n", fixed[i].c_str());
+            return 1;
+        }
+        assign(base, value.name, value.values[0]);
+    }
+    std::vector<axis> axes(grid.size());
+    int combinations = 1;
+    for (size_t i = 0; i < grid.size(); i++) {
+        if (!parseAxis(grid[i], axes[i])) {
+            PCL_ERROR("Bad sweep %s\n", grid[i].c_str());
+            return 1;
+        }
+        combinations *= axes[i].values.size();
+    }
+
+    running.reset(new progress("sweep"));
+    running->setListener(&printProgress);
+    std::signal(SIGINT, &interrupt);
+
+    int failures = 0;
+    for (size_t f = 0; f < files.size() && !running->isCancelled(); f++) {
+        PointCloudT::Ptr cloud(new PointCloudT);
+        if (pcl::io::loadPCDFile(files[f], *cloud) < 0) {
+            PCL_INFO("Could not load %s\n", files[f].c_str());
+            failures++;
+            continue;
+        }
+        const memo::cloudResult input = memo::input(cloud);
+
+        // last axis runs fastest, neighbouring combinations share more stages
+        std::vector<row> rows(combinations);
+        pcl::console::TicToc total;
+        total.tic();
+        int finished = 0;
+#pragma omp parallel for schedule(dynamic, 1)
+        for (int c = 0; c < combinations; c++) {
+            parameters local(base);
+            row &result = rows[c];
+            result.valid = false;
+            result.values.resize(axes.size());
+            for (int a = axes.size() - 1, rest = c; a >= 0; a--) {
+                result.values[a] = axes[a].values[rest % axes[a].values.size()];
+                rest /= axes[a].values.size();
+                assign(local, axes[a].name, result.values[a]);
+            }
+            parameters::SetLocalInstance(&local);
+            progress::Ptr job(new progress(files[f], running));
+            progress::setCurrent(job);
+            // every combination counts its own temporary clouds
+            pool::job clouds("sweep combination " + std::to_string(c));
+
+            pcl::console::TicToc tt;
+            tt.tic();
+            try {
+                progress::check();
+                memo::cloudResult sparse = memo::cloud("voxel", boost::bind(&filters::voxelGridFilter, _1, _2, 0.0f), input);
+                memo::meshResult surface = memo::mesh(mesher, function, sparse);
+                if (holes || decimate) {
+                    // nothing is shown, output of pipeline is not kept
+                    vtkSmartPointer<vtkPolyData> *shown = NULL;
+                    const std::string post = holes ? (decimate ? "holes+decimation" : "holes") : "decimation";
+                    surface = memo::post(post, boost::bind(&mesh::postProcess, _1, _2, holes, decimate, shown), surface);
+                }
+                result.time = tt.toc();
+                result.triangles = surface.mesh->triangleCount();
+                quality(*cloud, *surface.mesh, tolerance, result.rms, result.coverage);
+                result.valid = true;
+            }
+            catch (const progress::cancelledException &) {
+                // not started or interrupted combinations are reported as failed
+            }
+            catch (const std::exception &e) {
+                PCL_ERROR("Combination %d failed: %s\n", c, e.what());
+            }
+            progress::setCurrent(progress::Ptr());
+            parameters::SetLocalInstance(NULL);
+
+            int done;
+#pragma omp atomic capture
+            done = ++finished;
+            std::stringstream stage;
+            stage << files[f] << ": " << done << "/" << combinations << " combinations";
+            running->report((f + done / static_cast<double>(combinations)) / files.size(), stage.str());
+        }
+        if (running->isCancelled()) {
+            PCL_INFO("Sweep cancelled\n");
+        }
+
+        PCL_INFO("\n%s: %d points, %d combinations in %g ms, stages shared between combinations are counted once\n",
+                 files[f].c_str(), cloud->points.size(), combinations, total.toc());
+        std::stringstream header;
+        for (size_t a = 0; a < axes.size(); a++) {
+            header << axes[a].name << '\t';
+        }
+        PCL_INFO("%stime [ms]\ttriangles\trms [mm]\tcoverage\n", header.str().c_str());
+        for (int c = 0; c < combinations; c++) {
+            const row &result = rows[c];
+            std::stringstream line;
+            for (size_t a = 0; a < axes.size(); a++) {
+                line << result.values[a] << '\t';
+            }
+            if (result.valid) {
+                PCL_INFO("%s%.1f\t%d\t%.2f\t%.3f\n", line.str().c_str(), result.time, result.triangles, result.rms * 1000.0, result.coverage);
+            }
+            else {
+                PCL_INFO("%sfailed\n", line.str().c_str());
+                failures++;
+            }
+        }
+    }
+    std::signal(SIGINT, SIG_DFL);
+    const bool cancelled = running->isCancelled();
+    running.reset();
+    return failures == 0 && !cancelled ? 0 : 1;
+}
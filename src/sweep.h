@@ -0,0 +1,58 @@
+/*
+    This file is part of RoomScanner.
+
+    RoomScanner is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    RoomScanner is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with RoomScanner.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef SWEEP_H
+#define SWEEP_H
+
+#include "types.h"
+#include "parameters.h"
+#include "filters.h"
+#include "mesh.h"
+#include "memo.h"
+#include "progress.h"
+#include <string>
+#include <vector>
+
+// Reconstruction of clouds with every combination of parameter values.
+// Combinations run side by side, each with its own copy of parameters,
+// and share memoized stages they have in common.
+class sweep
+{
+public:
+    // values of one swept parameter
+    struct axis {
+        std::string name;
+        std::vector<double> values;
+    };
+
+    // result of one combination
+    struct row {
+        std::vector<double> values;
+        double time;
+        size_t triangles;
+        double rms;
+        double coverage;
+        bool valid;
+    };
+
+    static bool parseAxis(const std::string &text, axis &result);
+    static bool assign(parameters &params, const std::string &name, double value);
+    static void quality(const PointCloudT &cloud, const trimesh &triangles, float tolerance, double &rms, double &coverage);
+    static int run(const std::vector<std::string> &files, const std::vector<std::string> &grid, const std::vector<std::string> &fixed,
+                   const std::string &mesher, bool holes, bool decimate, float tolerance);
+};
+
+#endif // SWEEP_H
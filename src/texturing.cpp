@@ -46,12 +46,16 @@ bool texturing::stitchImages(std::vector<std::string> images) {
          }
          imgs.push_back(img);
      }
+     // reading takes first half, stitcher reports no progress
+     progress::update(0.5 * (i + 1) / images.size(), "Stitching images");
+     progress::check();
     }
 
 
      cv::Mat pano;
      cv::Ptr<cv::Stitcher> stitcher = cv::Stitcher::create(cv::Stitcher::SCANS, false);
      cv::Stitcher::Status status = stitcher->stitch(imgs, pano);
+     progress::check();
 
      if (status != cv::Stitcher::OK)
      {
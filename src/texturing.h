@@ -19,6 +19,7 @@
 #define TEXTURING_H
 
 #include "types.h"
+#include "progress.h"
 #include "opencv2/highgui.hpp"
 #include "opencv2/stitching.hpp"
 
@@ -0,0 +1,220 @@
+/*
+    This file is part of RoomScanner.
+
+    RoomScanner is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    RoomScanner is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with RoomScanner.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "trimesh.h"
+#include <vtkPoints.h>
+#include <vtkCellArray.h>
+#include <vtkIdList.h>
+#include <vtkIdTypeArray.h>
+#include <vtkPointData.h>
+#include <vtkUnsignedCharArray.h>
+#include <algorithm>
+
+/** \brief Memory held by attribute arrays and indices
+  */
+size_t trimesh::bytes() const {
+    return (positions.size() + colors.size() + indices.size()) * sizeof(uint32_t);
+}
+
+/** \brief Removes all vertices and triangles
+  */
+void trimesh::clear() {
+    positions.clear();
+    colors.clear();
+    indices.clear();
+}
+
+/** \brief Appends colored vertex
+  * \param p position and color of vertex
+  * \return index of vertex
+  */
+uint32_t trimesh::addVertex(const PointT &p) {
+    const uint32_t index = vertexCount();
+    positions.push_back(p.x);
+    positions.push_back(p.y);
+    positions.push_back(p.z);
+    colors.push_back(p.rgba);
+    return index;
+}
+
+/** \brief Appends triangle
+  * \param a index of first vertex
+  * \param b index of second vertex
+  * \param c index of third vertex
+  */
+void trimesh::addTriangle(uint32_t a, uint32_t b, uint32_t c) {
+    indices.push_back(a);
+    indices.push_back(b);
+    indices.push_back(c);
+}
+
+/** \brief Vertex as point, vertices of mesh without colors are white
+  * \param i index of vertex
+  */
+PointT trimesh::vertex(size_t i) const {
+    PointT p;
+    p.x = positions[3 * i];
+    p.y = positions[3 * i + 1];
+    p.z = positions[3 * i + 2];
+    p.rgba = hasColors() ? colors[i] : 0xffffffff;
+    return p;
+}
+
+/** \brief Copies mesh of pcl, polygons with more vertices are split to triangle fans
+  * \param mesh input mesh
+  */
+void trimesh::fromPolygonMesh(const pcl::PolygonMesh &mesh) {
+    clear();
+    bool colored = false;
+    for (size_t i = 0; i < mesh.cloud.fields.size(); i++) {
+        colored = colored || mesh.cloud.fields[i].name == "rgb" || mesh.cloud.fields[i].name == "rgba";
+    }
+    PointCloudT vertices;
+    pcl::fromPCLPointCloud2(mesh.cloud, vertices);
+    positions.resize(3 * vertices.points.size());
+    for (size_t i = 0; i < vertices.points.size(); i++) {
+        positions[3 * i] = vertices.points[i].x;
+        positions[3 * i + 1] = vertices.points[i].y;
+        positions[3 * i + 2] = vertices.points[i].z;
+    }
+    if (colored) {
+        colors.resize(vertices.points.size());
+        for (size_t i = 0; i < vertices.points.size(); i++) {
+            colors[i] = vertices.points[i].rgba;
+        }
+    }
+    indices.reserve(3 * mesh.polygons.size());
+    for (size_t i = 0; i < mesh.polygons.size(); i++) {
+        const std::vector<uint32_t> &polygon = mesh.polygons[i].vertices;
+        for (size_t k = 1; k + 1 < polygon.size(); k++) {
+            addTriangle(polygon[0], polygon[k], polygon[k + 1]);
+        }
+    }
+}
+
+/** \brief Builds mesh of pcl for its io and viewer
+  * \param mesh resultant mesh
+  */
+void trimesh::toPolygonMesh(pcl::PolygonMesh &mesh) const {
+    if (hasColors()) {
+        PointCloudT vertices;
+        vertices.points.resize(vertexCount());
+        for (size_t i = 0; i < vertexCount(); i++) {
+            vertices.points[i] = vertex(i);
+        }
+        vertices.width = vertices.points.size();
+        vertices.height = 1;
+        vertices.is_dense = true;
+        pcl::toPCLPointCloud2(vertices, mesh.cloud);
+    }
+    else {
+        pcl::PointCloud<pcl::PointXYZ> vertices;
+        vertices.points.resize(vertexCount());
+        for (size_t i = 0; i < vertexCount(); i++) {
+            vertices.points[i].x = positions[3 * i];
+            vertices.points[i].y = positions[3 * i + 1];
+            vertices.points[i].z = positions[3 * i + 2];
+        }
+        vertices.width = vertices.points.size();
+        vertices.height = 1;
+        vertices.is_dense = true;
+        pcl::toPCLPointCloud2(vertices, mesh.cloud);
+    }
+    mesh.polygons.resize(triangleCount());
+    for (size_t t = 0; t < triangleCount(); t++) {
+        mesh.polygons[t].vertices.assign(indices.begin() + 3 * t, indices.begin() + 3 * t + 3);
+    }
+}
+
+/** \brief Copies polygons of vtk data, colors are taken from point scalars
+  * \param polyData input data
+  */
+void trimesh::fromPolyData(vtkPolyData *polyData) {
+    clear();
+    if (polyData == NULL || polyData->GetPoints() == NULL) {
+        return;
+    }
+    const vtkIdType count = polyData->GetNumberOfPoints();
+    positions.resize(3 * count);
+    for (vtkIdType i = 0; i < count; i++) {
+        double p[3];
+        polyData->GetPoint(i, p);
+        positions[3 * i] = p[0];
+        positions[3 * i + 1] = p[1];
+        positions[3 * i + 2] = p[2];
+    }
+
+    vtkUnsignedCharArray *rgb = vtkUnsignedCharArray::SafeDownCast(polyData->GetPointData()->GetScalars());
+    if (rgb != NULL && rgb->GetNumberOfComponents() >= 3 && rgb->GetNumberOfTuples() == count) {
+        const int components = rgb->GetNumberOfComponents();
+        const unsigned char *c = rgb->GetPointer(0);
+        colors.resize(count);
+        for (vtkIdType i = 0; i < count; i++) {
+            colors[i] = 0xff000000u | (c[components * i] << 16) | (c[components * i + 1] << 8) | c[components * i + 2];
+        }
+    }
+
+    vtkCellArray *polys = polyData->GetPolys();
+    vtkSmartPointer<vtkIdList> cell = vtkSmartPointer<vtkIdList>::New();
+    indices.reserve(3 * polys->GetNumberOfCells());
+    polys->InitTraversal();
+    while (polys->GetNextCell(cell)) {
+        for (vtkIdType k = 1; k + 1 < cell->GetNumberOfIds(); k++) {
+            addTriangle(cell->GetId(0), cell->GetId(k), cell->GetId(k + 1));
+        }
+    }
+}
+
+/** \brief Builds vtk data with triangles and point colors
+  */
+vtkSmartPointer<vtkPolyData> trimesh::toPolyData() const {
+    vtkSmartPointer<vtkPoints> points = vtkSmartPointer<vtkPoints>::New();
+    points->SetDataTypeToFloat();
+    points->SetNumberOfPoints(vertexCount());
+    if (!positions.empty()) {
+        std::copy(positions.begin(), positions.end(), static_cast<float *>(points->GetVoidPointer(0)));
+    }
+
+    vtkSmartPointer<vtkIdTypeArray> cells = vtkSmartPointer<vtkIdTypeArray>::New();
+    cells->SetNumberOfValues(4 * triangleCount());
+    for (size_t t = 0; t < triangleCount(); t++) {
+        cells->SetValue(4 * t, 3);
+        cells->SetValue(4 * t + 1, indices[3 * t]);
+        cells->SetValue(4 * t + 2, indices[3 * t + 1]);
+        cells->SetValue(4 * t + 3, indices[3 * t + 2]);
+    }
+    vtkSmartPointer<vtkCellArray> polys = vtkSmartPointer<vtkCellArray>::New();
+    polys->SetCells(triangleCount(), cells);
+
+    vtkSmartPointer<vtkPolyData> polyData = vtkSmartPointer<vtkPolyData>::New();
+    polyData->SetPoints(points);
+    polyData->SetPolys(polys);
+
+    if (hasColors()) {
+        vtkSmartPointer<vtkUnsignedCharArray> rgb = vtkSmartPointer<vtkUnsignedCharArray>::New();
+        rgb->SetName("Colors");
+        rgb->SetNumberOfComponents(3);
+        rgb->SetNumberOfTuples(vertexCount());
+        unsigned char *c = rgb->GetPointer(0);
+        for (size_t i = 0; i < vertexCount(); i++) {
+            c[3 * i] = (colors[i] >> 16) & 0xff;
+            c[3 * i + 1] = (colors[i] >> 8) & 0xff;
+            c[3 * i + 2] = colors[i] & 0xff;
+        }
+        polyData->GetPointData()->SetScalars(rgb);
+    }
+    return polyData;
+}
@@ -0,0 +1,58 @@
+/*
+    This file is part of RoomScanner.
+
+    RoomScanner is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    RoomScanner is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with RoomScanner.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef TRIMESH_H
+#define TRIMESH_H
+
+#include "types.h"
+#include <pcl/PolygonMesh.h>
+#include <pcl/conversions.h>
+#include <vtkSmartPointer.h>
+#include <vtkPolyData.h>
+#include <boost/shared_ptr.hpp>
+#include <vector>
+#include <cstdint>
+
+// Triangle mesh with flat vertex attribute arrays and one index buffer,
+// 16 bytes per colored vertex and 12 bytes per triangle. Stages pass it
+// between each other, pcl::PolygonMesh and vtkPolyData are built only
+// at the edges (PCL meshers, viewer, model files).
+class trimesh
+{
+public:
+    typedef boost::shared_ptr<trimesh> Ptr;
+
+    std::vector<float> positions;  // x, y, z of each vertex
+    std::vector<uint32_t> colors;  // packed rgba of each vertex as in PointT, empty if mesh has no colors
+    std::vector<uint32_t> indices; // three vertices of each triangle
+
+    size_t vertexCount() const { return positions.size() / 3; }
+    size_t triangleCount() const { return indices.size() / 3; }
+    size_t bytes() const;
+    bool hasColors() const { return !colors.empty(); }
+
+    void clear();
+    uint32_t addVertex(const PointT &p);
+    void addTriangle(uint32_t a, uint32_t b, uint32_t c);
+    PointT vertex(size_t i) const;
+
+    void fromPolygonMesh(const pcl::PolygonMesh &mesh);
+    void toPolygonMesh(pcl::PolygonMesh &mesh) const;
+    void fromPolyData(vtkPolyData *polyData);
+    vtkSmartPointer<vtkPolyData> toPolyData() const;
+};
+
+#endif // TRIMESH_H
@@ -0,0 +1,443 @@
+/*
+    This file is part of RoomScanner.
+
+    RoomScanner is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    RoomScanner is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with RoomScanner.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "tsdf.h"
+#include <unordered_set>
+#include <limits>
+#include <cmath>
+
+/** \brief Creates empty volume
+  * \param voxelSize edge length of one voxel in meters
+  * \param truncation distance in meters where signed distance is truncated
+  */
+tsdf::tsdf(float voxelSize, float truncation)
+{
+    this->voxelSize = voxelSize;
+    this->truncation = truncation;
+}
+
+/** \brief Releases all allocated blocks
+  */
+void tsdf::clear() {
+    blocks.clear();
+}
+
+/** \brief Creates depth and color image of cloud in sensor coordinates
+  * Organized clouds are used directly, unorganized clouds are projected by pinhole model.
+  * \param cloud input cloud in sensor coordinates
+  * \param width resultant image width
+  * \param height resultant image height
+  * \param depth resultant depth image, NaN for missing measurement
+  * \param color resultant color image
+  */
+void tsdf::depthImage(const PointCloudT::Ptr &cloud, int &width, int &height, std::vector<float> &depth, std::vector<uint32_t> &color) const {
+    parameters* params = parameters::GetInstance();
+    const float nan = std::numeric_limits<float>::quiet_NaN();
+
+    if (cloud->isOrganized()) {
+        width = cloud->width;
+        height = cloud->height;
+        depth.resize(cloud->points.size());
+        color.resize(cloud->points.size());
+        for (size_t i = 0; i < cloud->points.size(); i++) {
+            const PointT &p = cloud->points[i];
+            depth[i] = std::isfinite(p.z) ? p.z : nan;
+            color[i] = p.rgba;
+        }
+        return;
+    }
+
+    width = params->TSDFwidth;
+    height = params->TSDFheight;
+    depth.assign(width * height, nan);
+    color.assign(width * height, 0);
+
+    const float focal = params->TSDFfocal * width / 640.0f;
+    const float cx = (width - 1) * 0.5f;
+    const float cy = (height - 1) * 0.5f;
+
+    for (size_t i = 0; i < cloud->points.size(); i++) {
+        const PointT &p = cloud->points[i];
+        if (!std::isfinite(p.x) || !std::isfinite(p.y) || !std::isfinite(p.z) || p.z <= 0.0f) {
+            continue;
+        }
+        int u = static_cast<int>(std::floor(focal * p.x / p.z + cx + 0.5f));
+        int v = static_cast<int>(std::floor(focal * p.y / p.z + cy + 0.5f));
+        if (u < 0 || v < 0 || u >= width || v >= height) {
+            continue;
+        }
+        float &d = depth[v * width + u];
+        if (!std::isfinite(d) || p.z < d) {
+            d = p.z;
+            color[v * width + u] = p.rgba;
+        }
+    }
+}
+
+/** \brief Fuses depth frame with known pose into volume
+  * \param cloud input cloud in sensor coordinates
+  * \param pose transformation from sensor to volume coordinates
+  */
+void tsdf::integrate(const PointCloudT::Ptr &cloud, const Eigen::Matrix4f &pose) {
+    parameters* params = parameters::GetInstance();
+
+    int width, height;
+    std::vector<float> depth;
+    std::vector<uint32_t> color;
+    depthImage(cloud, width, height, depth, color);
+
+    const float focal = params->TSDFfocal * width / 640.0f;
+    const float cx = (width - 1) * 0.5f;
+    const float cy = (height - 1) * 0.5f;
+    const float maxDepth = params->TSDFmaxDepth;
+    const float maxWeight = params->TSDFmaxWeight;
+    const float blockSide = voxelSize * BLOCK_SIZE;
+    const float step = std::min(truncation, blockSide) * 0.5f;
+
+    Eigen::Affine3f camToWorld(pose);
+    Eigen::Affine3f worldToCam = camToWorld.inverse();
+
+    // find blocks in truncation band of every measurement
+    std::vector<blockKey> found;
+#pragma omp parallel
+    {
+        std::vector<blockKey> local;
+#pragma omp for nowait
+        for (int v = 0; v < height; v++) {
+            for (int u = 0; u < width; u++) {
+                const float z = depth[v * width + u];
+                if (!std::isfinite(z) || z <= 0.0f || z > maxDepth) {
+                    continue;
+                }
+                Eigen::Vector3f ray((u - cx) / focal, (v - cy) / focal, 1.0f);
+                const float len = ray.norm();
+                for (float d = -truncation; d <= truncation; d += step) {
+                    Eigen::Vector3f pw = camToWorld * (ray * (z + d / len));
+                    blockKey key = {static_cast<int>(std::floor(pw.x() / blockSide)),
+                                    static_cast<int>(std::floor(pw.y() / blockSide)),
+                                    static_cast<int>(std::floor(pw.z() / blockSide))};
+                    if (local.empty() || !(local.back() == key)) {
+                        local.push_back(key);
+                    }
+                }
+            }
+        }
+#pragma omp critical
+        found.insert(found.end(), local.begin(), local.end());
+    }
+
+    // allocate new blocks, collect blocks to update
+    std::unordered_set<blockKey, blockKeyHash> visible(found.begin(), found.end());
+    std::vector<std::pair<blockKey, block*> > active;
+    active.reserve(visible.size());
+    for (std::unordered_set<blockKey, blockKeyHash>::const_iterator it = visible.begin(); it != visible.end(); ++it) {
+        blockMap::iterator b = blocks.find(*it);
+        if (b == blocks.end()) {
+            b = blocks.insert(std::make_pair(*it, block())).first;
+            for (int i = 0; i < BLOCK_VOXELS; i++) {
+                b->second.voxels[i].sdf = 1.0f;
+                b->second.voxels[i].weight = 0.0f;
+                b->second.voxels[i].r = b->second.voxels[i].g = b->second.voxels[i].b = 0;
+            }
+        }
+        active.push_back(std::make_pair(*it, &b->second));
+    }
+
+    // update voxels, every block is owned by one thread
+#pragma omp parallel for schedule(dynamic)
+    for (int i = 0; i < static_cast<int>(active.size()); i++) {
+        const blockKey &key = active[i].first;
+        block &b = *active[i].second;
+        for (int lz = 0; lz < BLOCK_SIZE; lz++) {
+            for (int ly = 0; ly < BLOCK_SIZE; ly++) {
+                for (int lx = 0; lx < BLOCK_SIZE; lx++) {
+                    Eigen::Vector3f pw((key.x * BLOCK_SIZE + lx) * voxelSize,
+                                       (key.y * BLOCK_SIZE + ly) * voxelSize,
+                                       (key.z * BLOCK_SIZE + lz) * voxelSize);
+                    Eigen::Vector3f pc = worldToCam * pw;
+                    if (pc.z() <= 0.0f) {
+                        continue;
+                    }
+                    int u = static_cast<int>(std::floor(focal * pc.x() / pc.z() + cx + 0.5f));
+                    int v = static_cast<int>(std::floor(focal * pc.y() / pc.z() + cy + 0.5f));
+                    if (u < 0 || v < 0 || u >= width || v >= height) {
+                        continue;
+                    }
+                    const float z = depth[v * width + u];
+                    if (!std::isfinite(z) || z > maxDepth) {
+                        continue;
+                    }
+                    const float sdf = z - pc.z();
+                    if (sdf < -truncation) {
+                        continue; // occluded
+                    }
+                    const float value = std::min(1.0f, sdf / truncation);
+
+                    voxel &vx = b.voxels[(lz * BLOCK_SIZE + ly) * BLOCK_SIZE + lx];
+                    const float w = vx.weight;
+                    vx.sdf = (vx.sdf * w + value) / (w + 1.0f);
+                    if (sdf < truncation) {
+                        const uint32_t rgb = color[v * width + u];
+                        vx.r = static_cast<unsigned char>((vx.r * w + ((rgb >> 16) & 0xff)) / (w + 1.0f));
+                        vx.g = static_cast<unsigned char>((vx.g * w + ((rgb >> 8) & 0xff)) / (w + 1.0f));
+                        vx.b = static_cast<unsigned char>((vx.b * w + (rgb & 0xff)) / (w + 1.0f));
+                    }
+                    vx.weight = std::min(w + 1.0f, maxWeight);
+                }
+            }
+        }
+    }
+    PCL_INFO("TSDF integrated frame, %d blocks updated, %d blocks allocated\n", active.size(), blocks.size());
+}
+
+/** \brief Returns voxel at integer grid coordinates
+  * \param x grid coordinate
+  * \param y grid coordinate
+  * \param z grid coordinate
+  * \param v resultant voxel
+  * \return true if voxel was observed
+  */
+bool tsdf::getVoxel(int x, int y, int z, voxel &v) const {
+    blockKey key = {floorDiv(x, BLOCK_SIZE), floorDiv(y, BLOCK_SIZE), floorDiv(z, BLOCK_SIZE)};
+    blockMap::const_iterator b = blocks.find(key);
+    if (b == blocks.end()) {
+        return false;
+    }
+    const int lx = x - key.x * BLOCK_SIZE;
+    const int ly = y - key.y * BLOCK_SIZE;
+    const int lz = z - key.z * BLOCK_SIZE;
+    v = b->second.voxels[(lz * BLOCK_SIZE + ly) * BLOCK_SIZE + lx];
+    return v.weight > 0.0f;
+}
+
+/** \brief Trilinear interpolation of signed distance
+  * \param p position in volume coordinates
+  * \param sdf resultant signed distance
+  * \return true if all surrounding voxels were observed
+  */
+bool tsdf::interpolate(const Eigen::Vector3f &p, float &sdf) const {
+    Eigen::Vector3f g = p / voxelSize;
+    const int x = static_cast<int>(std::floor(g.x()));
+    const int y = static_cast<int>(std::floor(g.y()));
+    const int z = static_cast<int>(std::floor(g.z()));
+    const float a = g.x() - x, b = g.y() - y, c = g.z() - z;
+
+    float values[8];
+    voxel v;
+    for (int i = 0; i < 8; i++) {
+        if (!getVoxel(x + (i & 1), y + ((i >> 1) & 1), z + ((i >> 2) & 1), v)) {
+            return false;
+        }
+        values[i] = v.sdf;
+    }
+    sdf = (1 - c) * ((1 - b) * ((1 - a) * values[0] + a * values[1]) + b * ((1 - a) * values[2] + a * values[3])) +
+          c * ((1 - b) * ((1 - a) * values[4] + a * values[5]) + b * ((1 - a) * values[6] + a * values[7]));
+    return true;
+}
+
+/** \brief Renders synthetic view of the model, used as target for frame-to-model alignment
+  * \param pose transformation from virtual sensor to volume coordinates
+  * \param width image width
+  * \param height image height
+  * \param output resultant organized cloud in volume coordinates
+  */
+void tsdf::raycast(const Eigen::Matrix4f &pose, int width, int height, PointCloudT &output) const {
+    parameters* params = parameters::GetInstance();
+    const float nan = std::numeric_limits<float>::quiet_NaN();
+    const float focal = params->TSDFfocal * width / 640.0f;
+    const float cx = (width - 1) * 0.5f;
+    const float cy = (height - 1) * 0.5f;
+    const float maxDepth = params->TSDFmaxDepth;
+    const float step = truncation * 0.5f;
+    const float blockStep = voxelSize * BLOCK_SIZE * 0.5f;
+
+    Eigen::Affine3f camToWorld(pose);
+    const Eigen::Vector3f origin = camToWorld.translation();
+    const Eigen::Matrix3f rotation = camToWorld.linear();
+
+    output.clear();
+    output.width = width;
+    output.height = height;
+    output.is_dense = false;
+    output.points.resize(width * height);
+
+#pragma omp parallel for schedule(dynamic)
+    for (int v = 0; v < height; v++) {
+        for (int u = 0; u < width; u++) {
+            PointT &p = output.points[v * width + u];
+            p.x = p.y = p.z = nan;
+            p.rgba = 0;
+
+            const Eigen::Vector3f dir = rotation * Eigen::Vector3f((u - cx) / focal, (v - cy) / focal, 1.0f).normalized();
+            float prevSdf = 0.0f;
+            bool prevValid = false;
+            for (float t = voxelSize; t < maxDepth; ) {
+                const Eigen::Vector3f pw = origin + dir * t;
+                voxel vx;
+                const int gx = static_cast<int>(std::floor(pw.x() / voxelSize + 0.5f));
+                const int gy = static_cast<int>(std::floor(pw.y() / voxelSize + 0.5f));
+                const int gz = static_cast<int>(std::floor(pw.z() / voxelSize + 0.5f));
+                if (!getVoxel(gx, gy, gz, vx)) {
+                    // empty space, skip faster
+                    prevValid = false;
+                    t += blockStep;
+                    continue;
+                }
+                float sdf = vx.sdf;
+                if (prevValid && prevSdf > 0.0f && sdf <= 0.0f) {
+                    // zero crossing, refine position
+                    float fine;
+                    const float tHit = t - step + step * prevSdf / (prevSdf - sdf);
+                    Eigen::Vector3f hit = origin + dir * tHit;
+                    if (interpolate(hit, fine)) {
+                        hit -= dir * (fine * truncation);
+                    }
+                    p.x = hit.x();
+                    p.y = hit.y();
+                    p.z = hit.z();
+                    p.r = vx.r;
+                    p.g = vx.g;
+                    p.b = vx.b;
+                    break;
+                }
+                if (prevValid && prevSdf < 0.0f && sdf > 0.0f) {
+                    break; // back side of surface
+                }
+                prevSdf = sdf;
+                prevValid = true;
+                t += step;
+            }
+        }
+    }
+}
+
+/** \brief Extracts points on zero level set
+  * \param output resultant cloud of surface points
+  */
+void tsdf::extractCloud(PointCloudT &output) const {
+    std::vector<const std::pair<const blockKey, block>*> list;
+    list.reserve(blocks.size());
+    for (blockMap::const_iterator it = blocks.begin(); it != blocks.end(); ++it) {
+        list.push_back(&(*it));
+    }
+
+    output.clear();
+#pragma omp parallel
+    {
+        PointCloudT local;
+#pragma omp for nowait schedule(dynamic)
+        for (int i = 0; i < static_cast<int>(list.size()); i++) {
+            const blockKey &key = list[i]->first;
+            const block &b = list[i]->second;
+            for (int lz = 0; lz < BLOCK_SIZE; lz++) {
+                for (int ly = 0; ly < BLOCK_SIZE; ly++) {
+                    for (int lx = 0; lx < BLOCK_SIZE; lx++) {
+                        const voxel &vx = b.voxels[(lz * BLOCK_SIZE + ly) * BLOCK_SIZE + lx];
+                        if (vx.weight <= 0.0f || vx.sdf >= 1.0f) {
+                            continue;
+                        }
+                        const int g[3] = {key.x * BLOCK_SIZE + lx, key.y * BLOCK_SIZE + ly, key.z * BLOCK_SIZE + lz};
+                        for (int axis = 0; axis < 3; axis++) {
+                            int n[3] = {g[0], g[1], g[2]};
+                            n[axis]++;
+                            voxel nv;
+                            if (!getVoxel(n[0], n[1], n[2], nv) || ((vx.sdf >= 0.0f) == (nv.sdf >= 0.0f))) {
+                                continue;
+                            }
+                            const float t = vx.sdf / (vx.sdf - nv.sdf);
+                            PointT p;
+                            p.x = g[0] * voxelSize;
+                            p.y = g[1] * voxelSize;
+                            p.z = g[2] * voxelSize;
+                            (&p.x)[axis] += t * voxelSize;
+                            const voxel &c = (t < 0.5f) ? vx : nv;
+                            p.r = c.r;
+                            p.g = c.g;
+                            p.b = c.b;
+                            local.points.push_back(p);
+                        }
+                    }
+                }
+            }
+        }
+#pragma omp critical
+        output.points.insert(output.points.end(), local.points.begin(), local.points.end());
+    }
+    output.width = output.points.size();
+    output.height = 1;
+    output.is_dense = true;
+    PCL_INFO("TSDF surface has %d points\n", output.points.size());
+}
+
+/** \brief Extracts triangle mesh from zero level set by marching cubes
+  * \param triangles resultant mesh
+  */
+void tsdf::extractMesh(trimesh &triangles) const {
+    marchingcubes::extract(field(*this), triangles);
+}
+
+/** \brief Fuses single organized frame into new volume and extracts its surface
+  * \param cloud input organized cloud in sensor coordinates
+  * \param triangles resultant mesh
+  */
+void tsdf::meshFrame(PointCloudT::Ptr cloud, trimesh::Ptr triangles) {
+    parameters* params = parameters::GetInstance();
+    tsdf frameVolume(params->TSDFvoxelSize, params->TSDFtruncation);
+    frameVolume.integrate(cloud, Eigen::Matrix4f::Identity());
+    frameVolume.extractMesh(*triangles);
+}
+
+/** \brief Lists allocated blocks
+  * \param keys resultant block coordinates
+  */
+void tsdf::field::blocks(std::vector<Eigen::Vector3i> &keys) const {
+    keys.clear();
+    keys.reserve(volume.blocks.size());
+    for (blockMap::const_iterator it = volume.blocks.begin(); it != volume.blocks.end(); ++it) {
+        keys.push_back(Eigen::Vector3i(it->first.x, it->first.y, it->first.z));
+    }
+}
+
+/** \brief Samples block including border voxels of neighbor blocks
+  * \param key block coordinates
+  * \param values resultant signed distances, NaN for unobserved voxels
+  * \param colors resultant voxel colors
+  */
+void tsdf::field::sample(const Eigen::Vector3i &key, float *values, uint32_t *colors) const {
+    const float nan = std::numeric_limits<float>::quiet_NaN();
+    const blockKey own = {key.x(), key.y(), key.z()};
+    const block &b = volume.blocks.find(own)->second;
+    const int samples = marchingcubes::SAMPLES;
+
+    for (int z = 0; z < samples; z++) {
+        for (int y = 0; y < samples; y++) {
+            for (int x = 0; x < samples; x++) {
+                const int i = (z * samples + y) * samples + x;
+                // voxels outside of allocated blocks are unobserved and black
+                voxel v = voxel();
+                if (x < BLOCK_SIZE && y < BLOCK_SIZE && z < BLOCK_SIZE) {
+                    v = b.voxels[(z * BLOCK_SIZE + y) * BLOCK_SIZE + x];
+                }
+                else if (!volume.getVoxel(key.x() * BLOCK_SIZE + x, key.y() * BLOCK_SIZE + y, key.z() * BLOCK_SIZE + z, v)) {
+                    v = voxel();
+                }
+                values[i] = (v.weight > 0.0f) ? v.sdf : nan;
+                colors[i] = (static_cast<uint32_t>(v.r) << 16) | (static_cast<uint32_t>(v.g) << 8) | v.b;
+            }
+        }
+    }
+}
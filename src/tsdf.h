@@ -0,0 +1,102 @@
+/*
+    This file is part of RoomScanner.
+
+    RoomScanner is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    RoomScanner is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with RoomScanner.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TSDF_H
+#define TSDF_H
+
+#include "types.h"
+#include "parameters.h"
+#include "marchingcubes.h"
+#include "trimesh.h"
+#include <boost/shared_ptr.hpp>
+#include <unordered_map>
+#include <vector>
+
+// Truncated signed distance volume stored in sparse voxel blocks.
+// Only blocks close to observed surfaces are allocated.
+class tsdf
+{
+public:
+    typedef boost::shared_ptr<tsdf> Ptr;
+
+    // voxels per block side, blocks are extracted by marching cubes directly
+    static const int BLOCK_SIZE = marchingcubes::BLOCK_SIZE;
+    static const int BLOCK_VOXELS = BLOCK_SIZE * BLOCK_SIZE * BLOCK_SIZE;
+
+    struct voxel {
+        float sdf;
+        float weight;
+        unsigned char r, g, b;
+    };
+
+    struct block {
+        voxel voxels[BLOCK_VOXELS];
+    };
+
+    struct blockKey {
+        int x, y, z;
+        bool operator==(const blockKey &other) const {
+            return x == other.x && y == other.y && z == other.z;
+        }
+    };
+
+    struct blockKeyHash {
+        size_t operator()(const blockKey &k) const {
+            return (static_cast<size_t>(k.x) * 73856093u) ^ (static_cast<size_t>(k.y) * 19349663u) ^ (static_cast<size_t>(k.z) * 83492791u);
+        }
+    };
+
+    typedef std::unordered_map<blockKey, block, blockKeyHash> blockMap;
+
+    tsdf(float voxelSize, float truncation);
+    void clear();
+    void integrate(const PointCloudT::Ptr &cloud, const Eigen::Matrix4f &pose);
+    void raycast(const Eigen::Matrix4f &pose, int width, int height, PointCloudT &output) const;
+    void extractCloud(PointCloudT &output) const;
+    void extractMesh(trimesh &triangles) const;
+    static void meshFrame(PointCloudT::Ptr cloud, trimesh::Ptr triangles);
+
+    bool getVoxel(int x, int y, int z, voxel &v) const;
+    size_t blockCount() const { return blocks.size(); }
+    float getVoxelSize() const { return voxelSize; }
+    float getTruncation() const { return truncation; }
+    const blockMap &getBlocks() const { return blocks; }
+
+    // volume as input of marching cubes
+    class field : public marchingcubes::field
+    {
+    public:
+        field(const tsdf &volume) : volume(volume) {}
+        float voxelSize() const { return volume.voxelSize; }
+        void blocks(std::vector<Eigen::Vector3i> &keys) const;
+        void sample(const Eigen::Vector3i &key, float *values, uint32_t *colors) const;
+
+    private:
+        const tsdf &volume;
+    };
+
+private:
+    void depthImage(const PointCloudT::Ptr &cloud, int &width, int &height, std::vector<float> &depth, std::vector<uint32_t> &color) const;
+    bool interpolate(const Eigen::Vector3f &p, float &sdf) const;
+    static int floorDiv(int a, int b) { return (a >= 0) ? a / b : -((-a + b - 1) / b); }
+
+    float voxelSize;
+    float truncation;
+    blockMap blocks;
+};
+
+#endif // TSDF_H